@@ -1,3 +1,4 @@
+#include <getopt.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -5,26 +6,57 @@
 #include "headers/parser.h"
 #include "headers/encode.h"
 #include "headers/instructions.h"
+#include "headers/program.h"
+#include "headers/writer.h"
 #include "headers/assemble.h"
 
-#define FREE_TABLES() symtable_free(known_table); symtable_free(unknown_table);
+#define FREE_TABLES() symtable_free(known_table); symtable_free(unknown_table); \
+    program_free(program); pending_free(pending); writer_free(writer); free(input_buffer);
 #define FAIL_RUNNING_PROGRAM() fclose(input_file); \
-    fclose(output_file); return EXIT_FAILURE;
+    fclose(output_file); if (symbol_file != NULL) fclose(symbol_file); return EXIT_FAILURE;
+#define FAIL_OUT_OF_MEMORY() fprintf(stderr, "Error: ran out of memory for the program\n"); \
+    FREE_TABLES(); FAIL_RUNNING_PROGRAM();
+#define FAIL_WRITING(pos) fprintf(stderr, "Error: writing line %u to output file failed\n", pos); \
+    FREE_TABLES(); FAIL_RUNNING_PROGRAM();
 
-#define MAX_LINE_LEN         50
-#define MAX_NUM_INSTRUCTIONS 100
 #define SYMTABLE_LOAD_FACTOR 2.0
 
+static const struct option long_options[] = {
+    { "stream", no_argument, NULL, 's' },
+    { NULL,     0,           NULL, 0   }
+};
+
+/*
+    Prints the usage message and exits with failure.
+*/
+static void usage(void) {
+    fprintf(stderr, "usage: ./assemble [--stream] [input_file] [output_file] [optional_symbol_file]\n");
+    exit(EXIT_FAILURE);
+}
+
 int run_assembler(int argc, char **argv) {
-    // Ensure both input and output filenames are provided
-    if (argc != 3) {
-        fprintf(stderr, "usage: ./assemble [input_file] [output_file]\n");
-        return EXIT_FAILURE;
+    // When streaming, each line is written as soon as it is parsed, and only the
+    // instructions waiting on a forward reference are kept until their label is found
+    bool streaming = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s", long_options, NULL)) != -1) {
+        if (opt == 's') {
+            streaming = true;
+        } else {
+            usage();
+        }
+    }
+    // Ensure both input and output filenames are provided; the symbol file is optional
+    int num_files = argc - optind;
+    if (num_files != 2 && num_files != 3) {
+        usage();
     }
-    char *input_filename = argv[1];
-    char *output_filename = argv[2];
+    char *input_filename = argv[optind];
+    char *output_filename = argv[optind + 1];
+    char *symbol_filename = num_files == 3 ? argv[optind + 2] : NULL;
     static FILE *input_file = NULL;
     static FILE *output_file = NULL;
+    static FILE *symbol_file = NULL;
 
     // Open input and output files
     input_file = fopen(input_filename, "r");
@@ -32,7 +64,12 @@ int run_assembler(int argc, char **argv) {
         fprintf(stderr, "Error: could not open input file for reading: %s\n", input_filename);
         return EXIT_FAILURE;
     }
-    output_file = fopen(output_filename, "w");
+    // the output file is also read from, so that it can be mapped into memory,
+    // unless it is something like a pipe that can only be written
+    output_file = fopen(output_filename, "w+");
+    if (output_file == NULL) {
+        output_file = fopen(output_filename, "w");
+    }
     if (output_file == NULL) {
         fprintf(stderr, "Error: could not open output file for writing binary: %s\n", output_filename);
         fclose(input_file);
@@ -41,10 +78,21 @@ int run_assembler(int argc, char **argv) {
         fprintf(stderr, "Error: input filename is identical to output filename");
         FAIL_RUNNING_PROGRAM();
     }
+    // The symbol file lists the address of each label, for the emulator's profiler
+    if (symbol_filename != NULL) {
+        symbol_file = fopen(symbol_filename, "w");
+        if (symbol_file == NULL) {
+            fprintf(stderr, "Error: could not open symbol file for writing: %s\n", symbol_filename);
+            FAIL_RUNNING_PROGRAM();
+        }
+    }
 
     // Loop through each line until EOF, parsing and encoding as needed and writing to output file
-    char input_buffer[MAX_LINE_LEN];
+    // getline grows the buffer to fit each line, so lines have no length limit
+    char *input_buffer = NULL;
+    size_t input_buffer_len = 0;
     uint32_t cur_pos = 0;
+    uint32_t line_num = 0;
 
     SymbolTable known_table = symtable_new(/* load_factor = */ SYMTABLE_LOAD_FACTOR);
     if (known_table == NULL) {
@@ -54,12 +102,30 @@ int run_assembler(int argc, char **argv) {
     SymbolTable unknown_table = symtable_new(/* load_factor = */ SYMTABLE_LOAD_FACTOR);
     if (unknown_table == NULL) {
         fprintf(stderr, "Error: failed to create unknown symbol table\n");
+        symtable_free(known_table);
+        FAIL_RUNNING_PROGRAM();
+    }
+    Program program = program_new();
+    PendingLines pending = pending_new();
+    Writer writer = writer_new(output_file);
+    if (program == NULL || pending == NULL || writer == NULL) {
+        fprintf(stderr, "Error: failed to create program\n");
+        symtable_free(known_table);
+        symtable_free(unknown_table);
+        if (program != NULL) program_free(program);
+        if (pending != NULL) pending_free(pending);
+        if (writer != NULL) writer_free(writer);
+        FAIL_RUNNING_PROGRAM();
+    }
+    // forward references are patched into words already written out, so the output must be seekable
+    if (streaming && !writer_seekable(writer)) {
+        fprintf(stderr, "Error: --stream needs a seekable output file\n");
+        FREE_TABLES();
         FAIL_RUNNING_PROGRAM();
     }
 
-    ProgramLine program[MAX_NUM_INSTRUCTIONS];
-    while ( cur_pos < MAX_NUM_INSTRUCTIONS && fgets(input_buffer, MAX_LINE_LEN, input_file) != NULL ) {
-        // TODO: resizing array for instructions
+    while (getline(&input_buffer, &input_buffer_len, input_file) != -1) {
+        line_num++;
         // replace newline if it exists
         char *newline = NULL;
         if ((newline = strchr(input_buffer, '\n')) != NULL) {
@@ -70,29 +136,79 @@ int run_assembler(int argc, char **argv) {
         char *unconsumed = input_buffer;
         // skip any indent
         skip_whitespace(&unconsumed);
-        ProgramLine *cur_line = &program[cur_pos];
-        if (parse_instruction(&unconsumed, &inst, cur_pos, known_table, unknown_table)) {
-            // Write instruction to buffer
-            cur_line->is_instruction = true;
-            cur_line->data.inst = inst;
+        uint32_t num_unknown = symtable_size(unknown_table);
+        ParseError error = { .message = NULL };
+        if (parse_instruction(&unconsumed, &inst, cur_pos, known_table, unknown_table, &error)) {
+            if (streaming) {
+                // an instruction waiting on a label is written as a placeholder, and patched once it is found
+                bool waiting = symtable_size(unknown_table) > num_unknown;
+                if (waiting && !pending_add(pending, cur_pos, &inst)) {
+                    FAIL_OUT_OF_MEMORY();
+                }
+                if (!writer_write(writer, waiting ? 0 : encode(&inst))) {
+                    FAIL_WRITING(cur_pos);
+                }
+            } else {
+                // Write instruction to buffer
+                ProgramLine *cur_line = program_append(program);
+                if (cur_line == NULL) {
+                    FAIL_OUT_OF_MEMORY();
+                }
+                cur_line->is_instruction = true;
+                cur_line->data.inst = inst;
+            }
             cur_pos++;
         }
         else if (parse_directive(&unconsumed, &directive)) {
-            // Write directive to buffer
-            cur_line->is_instruction = false;
-            cur_line->data.directive = directive;
+            if (streaming) {
+                if (!writer_write(writer, (uint32_t) directive)) {
+                    FAIL_WRITING(cur_pos);
+                }
+            } else {
+                // Write directive to buffer
+                ProgramLine *cur_line = program_append(program);
+                if (cur_line == NULL) {
+                    FAIL_OUT_OF_MEMORY();
+                }
+                cur_line->is_instruction = false;
+                cur_line->data.directive = directive;
+            }
             cur_pos++;
         } else if (parse_label(&unconsumed, cur_pos, known_table)) {
             // Correct all forward references from unknown table
             uint32_t back_line;
             char *label = unconsumed;
             while (multi_symtable_remove_last(unknown_table, label, &back_line)) {
-                set_offset(&program[back_line].data.inst, /* inst_pos = */ back_line, /* target_pos = */ cur_pos);
+                if (streaming) {
+                    Instruction *back_inst = pending_get(pending, back_line);
+                    if (back_inst == NULL) {
+                        // every forward reference was kept in pending when it was parsed
+                        fprintf(stderr, "Error: no pending instruction at line %u for label %s\n", back_line, label);
+                        FREE_TABLES();
+                        FAIL_RUNNING_PROGRAM();
+                    }
+                    set_offset(back_inst, /* inst_pos = */ back_line, /* target_pos = */ cur_pos);
+                    if (!writer_patch(writer, back_line, encode(back_inst))) {
+                        FAIL_WRITING(back_line);
+                    }
+                    pending_remove(pending, back_line);
+                } else {
+                    set_offset(&program_line(program, back_line)->data.inst,
+                               /* inst_pos = */ back_line, /* target_pos = */ cur_pos);
+                }
             }
             multi_symtable_remove_all(unknown_table, label, NULL);
+            if (symbol_file != NULL) {
+                fprintf(symbol_file, "%08x %s\n", cur_pos * 4, label);
+            }
         } else if (!(skip_whitespace(&unconsumed) || *unconsumed == '\0')){
             // unknown, non-empty input
-            fprintf(stderr, "Error: unknown input %s\n", unconsumed);
+            if (error.message != NULL) {
+                fprintf(stderr, "Error: line %u, column %td: %s\n",
+                        line_num, error.at - input_buffer + 1, error.message);
+            } else {
+                fprintf(stderr, "Error: unknown input %s\n", unconsumed);
+            }
             // free any existing structures
             FREE_TABLES();
             FAIL_RUNNING_PROGRAM();
@@ -106,27 +222,38 @@ int run_assembler(int argc, char **argv) {
         FAIL_RUNNING_PROGRAM();
     }
 
-    for (int pos = 0; pos < cur_pos; pos++) {
-        ProgramLine cur_line = program[pos];
-        uint32_t encoded = cur_line.is_instruction
-            ? encode(&cur_line.data.inst)
-            : (uint32_t) cur_line.data.directive;
-        // write encoded file byte by byte
-        for (int i = 0; i < sizeof(uint32_t); i++) {
-            char b = (char) (encoded & 0xFF);
-            if (putc(b, output_file) == EOF) {
-                // error when writing to output file
-                fprintf(stderr, "Error: writing line %d to output file failed\n", i);
-                FREE_TABLES();
-                FAIL_RUNNING_PROGRAM();
-            }
-            encoded >>= 8;
+    if (streaming) {
+        // every line has already been written, apart from those still in the buffer
+        if (!writer_flush(writer)) {
+            FAIL_WRITING(cur_pos);
+        }
+    } else {
+        // encode straight into an image of the output file, sized from the number of lines
+        uint8_t *image = writer_map(writer, cur_pos);
+        if (image == NULL) {
+            FAIL_OUT_OF_MEMORY();
+        }
+        for (uint32_t pos = 0; pos < cur_pos; pos++) {
+            ProgramLine *cur_line = program_line(program, pos);
+            put_word(&image[pos * sizeof(uint32_t)], cur_line->is_instruction
+                ? encode(&cur_line->data.inst)
+                : (uint32_t) cur_line->data.directive);
+        }
+        if (!writer_unmap(writer)) {
+            FAIL_WRITING(cur_pos);
         }
     }
 
     FREE_TABLES();
     fclose(input_file);
-    fclose(output_file);
+    if (fclose(output_file) == EOF) {
+        fprintf(stderr, "Error: writing to output file failed\n");
+        if (symbol_file != NULL) fclose(symbol_file);
+        return EXIT_FAILURE;
+    }
+    if (symbol_file != NULL) {
+        fclose(symbol_file);
+    }
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,121 @@
+/* Implementation for the operand lexer.
+ * Each token is recognised from its first character, so no character is read twice. */
+
+#include "../headers/lexer.h"
+#include "../headers/parser.h"
+#include "../headers/registers.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// the characters that end a word, besides whitespace
+#define DELIMITERS "[],#!:"
+
+/** Determines whether a character can be part of a word.
+ * @param c the character
+ */
+static bool is_word_char(char c) {
+    return c != '\0' && !isspace((unsigned char) c) && strchr(DELIMITERS, c) == NULL;
+}
+
+/** Reads a number: an optional minus sign, then either 0x and hexadecimal digits, or decimal digits.
+ * @param src a pointer to the first character, advanced past the number if it is read
+ * @param value a pointer to which the number is written
+ * @returns `true` if a number was read, and `false` otherwise
+ */
+static bool lex_number(const char **src, int64_t *value) {
+    const char *s = *src;
+    bool negative = *s == '-';
+    if (negative) s++;
+    int base = 10;
+    if (s[0] == '0' && s[1] == 'x' && isxdigit((unsigned char) s[2])) {
+        base = 16;
+        s += 2;
+    } else if (!isdigit((unsigned char) *s)) {
+        return false;
+    }
+    int64_t result = 0;
+    for (; isxdigit((unsigned char) *s) && (base == 16 || isdigit((unsigned char) *s)); s++) {
+        int digit = isdigit((unsigned char) *s) ? *s - '0' : tolower((unsigned char) *s) - 'a' + 10;
+        // saturate, so that an out of range value is still out of range
+        result = result > (INT64_MAX - digit) / base ? INT64_MAX : result * base + digit;
+    }
+    *src = s;
+    *value = negative ? -result : result;
+    return true;
+}
+
+/** Determines whether a word is a register: w or x, followed by zr or an index below NUM_GENERAL_REGISTERS.
+ * If it is, the token is written with the register.
+ * @param start the first character of the word
+ * @param len the length of the word
+ * @param token the token to write to
+ * @returns `true` if and only if the word is a register
+ */
+static bool lex_register(const char *start, size_t len, Token *token) {
+    if (len < 2 || (start[0] != 'w' && start[0] != 'x')) return false;
+    RegisterWidth width = start[0] == 'w' ? _32_BIT : _64_BIT;
+    int index;
+    if (len == 3 && start[1] == 'z' && start[2] == 'r') {
+        index = ZERO_REG_INDEX;
+    } else {
+        if (len > 3) return false;
+        index = 0;
+        for (size_t i = 1; i < len; i++) {
+            if (!isdigit((unsigned char) start[i])) return false;
+            index = index * 10 + start[i] - '0';
+        }
+        if (index >= NUM_GENERAL_REGISTERS) return false;
+    }
+    token->type = TOKEN_REGISTER;
+    token->data.reg.index = index;
+    token->data.reg.width = width;
+    return true;
+}
+
+/** Splits the operands of an instruction into tokens, ending with a TOKEN_END.
+ * @param src the first character after the mnemonic
+ * @param tokens the array to which the tokens are written
+ * @param error_at a pointer to which the position of an unexpected character is written, if lexing fails
+ * @returns `true` if lexing succeeds, and `false` if a character cannot start a token,
+ * or there are more than MAX_TOKENS tokens
+ */
+bool lex_operands(const char *src, Token tokens[MAX_TOKENS], const char **error_at) {
+    const char *s = src;
+    for (int num_tokens = 0; num_tokens < MAX_TOKENS; num_tokens++) {
+        while (isspace((unsigned char) *s)) s++;
+        Token *token = &tokens[num_tokens];
+        token->start = s;
+        switch (*s) {
+            case '\0': token->type = TOKEN_END;      return true;
+            case '[':  token->type = TOKEN_LBRACKET; s++; continue;
+            case ']':  token->type = TOKEN_RBRACKET; s++; continue;
+            case ',':  token->type = TOKEN_COMMA;    s++; continue;
+            case '!':  token->type = TOKEN_BANG;     s++; continue;
+            case '#':
+                s++;
+                if (!lex_number(&s, &token->data.value)) {
+                    *error_at = s;
+                    return false;
+                }
+                token->type = TOKEN_IMMEDIATE;
+                continue;
+        }
+        if (lex_number(&s, &token->data.value)) {
+            token->type = TOKEN_NUMBER;
+            continue;
+        }
+        if (!is_word_char(*s)) {
+            *error_at = s;
+            return false;
+        }
+        while (is_word_char(*s)) s++;
+        if (!lex_register(token->start, s - token->start, token)) {
+            token->type = TOKEN_WORD;
+        }
+    }
+    // no room is left for TOKEN_END
+    *error_at = s;
+    return false;
+}
@@ -4,6 +4,7 @@
 #include <errno.h>
 #include <ctype.h>
 #include <stdint.h>
+#include "../headers/lexer.h"
 #include "../headers/parser.h"
 #include "../headers/registers.h"
 #include "../headers/instruction_constants.h"
@@ -12,6 +13,35 @@ const char *const branch_conds[] = { "eq", "ne", "ge", "lt", "gt", "le", "al", N
 static const uint8_t cond_map[]  = { 0x0, 0x1, 0xa, 0xb, 0xc, 0xd, 0xe };
 const char *const shift_types[]  = {"lsl", "lsr", "asr", "ror"};
 
+// The operands an instruction takes, for mnemonics whose handler parses several forms.
+typedef enum {
+    ARITH_RD_RN, ARITH_RN, ARITH_RD,
+    LOGIC_RD_RN, LOGIC_MVN, LOGIC_MOV, LOGIC_TST,
+    BRANCH_UNCOND, BRANCH_COND,
+    NO_FORM
+} OperandForm;
+
+typedef struct mnemonic Mnemonic;
+
+// Parses the operands of an instruction, given its mnemonic, with src just past the mnemonic.
+typedef bool (*MnemonicParser)(char **src, const Mnemonic *mnemonic, Instruction *instruction,
+                               uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table,
+                               ParseError *error);
+
+/**
+ * A structure representing a mnemonic, and how to parse the operands after it.
+ * @property name the mnemonic
+ * @property parse the handler for the operands
+ * @property opc the opcode, logic type, condition or load flag given by the mnemonic, depending on the handler
+ * @property form the operands taken, if the handler parses several forms
+ */
+struct mnemonic {
+    const char *name;
+    MnemonicParser parse;
+    uint8_t opc;
+    OperandForm form;
+};
+
 /** Matches a single character, incrementing src and returning true if and only
  * if the first character in src matches that of token.
  */
@@ -34,17 +64,6 @@ static bool match_string(char **src, const char *token) {
     return true;
 }
 
-static bool parse_from(char **src, const char * const tokens[], int *index) {
-    for (int i = 0; tokens[i] != NULL; i++) {
-        if (match_string(src, tokens[i])) {
-            // write the token index chosen
-            *index = i;
-            return true;
-        }
-    }
-    return false;
-}
-
 /** Skips a continuous block of whitespace beginning at the current position
  * pointed to by `src`.
  * @returns true if at least one character of whitespace is matched.
@@ -346,33 +365,20 @@ static bool parse_reg_op2(
     return true;
 }
 
-/** Parses an instruction that has one of the forms:
+/** Parses the operands of an instruction that has one of the forms:
  * [add|adds|sub|subs] Rd, Rn, #imm{, lsl #(0|12)}
  * [cmp|cmn] Rn, #imm{, lsl #(0|12)}
  * [neg|negs] Rd, #imm{, lsl #(0|12)}
+ * The mnemonic gives the opcode, and which of Rd and Rn are written.
  * @returns true and modifies src to point towards the beginning of the
  * unconsumed input, if and only if parsing succeeds
  */
-static bool parse_add_sub(char **src, Instruction *instruction) {
+static bool parse_add_sub(char **src, const Mnemonic *mnemonic, Instruction *instruction,
+                          uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table,
+                          ParseError *error) {
     Instruction inst;
     char *s = *src;
-    ArithOpc opc;
     bool success;
-    // mnemonics and the aliases they map to
-    const char *const add_types[]  = {"add", NULL};
-    const char *const adds_types[] = {"adds", "cmn", NULL};
-    const char *const sub_types[]  = {"sub", "neg", NULL};
-    const char *const subs_types[] = {"cmp", "subs", "negs", NULL};
-    // set opcode
-    // choose this order so that "adds" is checked before "add"
-    // in order to select the correct opcode
-    int i;
-    const char *mnemonic;
-    if      (parse_from(&s, adds_types, &i)) { opc = ADDS; mnemonic = adds_types[i]; }
-    else if (parse_from(&s, add_types,  &i)) { opc = ADD;  mnemonic = add_types[i];  }
-    else if (parse_from(&s, subs_types, &i)) { opc = SUBS; mnemonic = subs_types[i]; }
-    else if (parse_from(&s, sub_types,  &i)) { opc = SUB;  mnemonic = sub_types[i];  }
-    else return false;
     // set registers
     uint8_t rd = ZERO_REG_INDEX;
     uint8_t rn = ZERO_REG_INDEX;
@@ -380,30 +386,27 @@ static bool parse_add_sub(char **src, Instruction *instruction) {
     // the number for DP (register) will be one greater
     int num_registers = 0;
     uint8_t *register_indices[MAX_ARITH_IMM_REGS];
-    // reset string back to original to check how many registers to add
-    s = *src;
-    if (match_string(&s, "cmp") || match_string(&s, "cmn")) {
-        // "cmp Rn, <op2>" is an alias for "subs Rzr, Rn, <op2>"
-        // (and the same for cmn with adds)
-        num_registers = 1;
-        register_indices[0] = &rn;
-    } else if (match_string(&s, "negs") || match_string(&s, "neg")) {
-        // "neg(s) rd, <op2>" is an alias for "sub(s) rd, rzr, <op2>"
-        num_registers = 1;
-        register_indices[0] = &rd;
-    } else {
-        // all other instructions have two operands rd and rn
-        num_registers = 2;
-        register_indices[0] = &rd;
-        register_indices[1] = &rn;
+    switch (mnemonic->form) {
+        case ARITH_RN:
+            // "cmp Rn, <op2>" is an alias for "subs Rzr, Rn, <op2>"
+            // (and the same for cmn with adds)
+            num_registers = 1;
+            register_indices[0] = &rn;
+            break;
+        case ARITH_RD:
+            // "neg(s) rd, <op2>" is an alias for "sub(s) rd, rzr, <op2>"
+            num_registers = 1;
+            register_indices[0] = &rd;
+            break;
+        default:
+            // all other instructions have two operands rd and rn
+            num_registers = 2;
+            register_indices[0] = &rd;
+            register_indices[1] = &rn;
     }
-    // reset string back to original and parse the operands
-    s = *src;
     RegisterWidth cur_width;
     RegisterWidth next_width;
-    success = match_string(&s, mnemonic)
-           && skip_whitespace(&s);
-    if (!success) return false;
+    if (!skip_whitespace(&s)) return false;
     // check all registers are of the same width
     for (int i = 0; i < num_registers; i++) {
         success = parse_reg(&s, register_indices[i], &cur_width)
@@ -422,7 +425,7 @@ static bool parse_add_sub(char **src, Instruction *instruction) {
     if (!success) return false;
     // set rd and opc
     inst.rd = rd;
-    inst.opc = opc;
+    inst.opc = mnemonic->opc;
     switch (inst.command_format) {
         case DP_IMM: break; // handled already
         case DP_REG: {
@@ -437,21 +440,20 @@ static bool parse_add_sub(char **src, Instruction *instruction) {
     return true;
 }
 
-/** Parses an instruction of one of the the forms:
+/** Parses the operands of an instruction of one of the the forms:
  * [ands|and|bics|bic|eor|eon|orr|orn] Rd, Rn, < op2 >
  * [tst|mvn] Rn, < op2 >
  * [mov] Rd, Rm
+ * The mnemonic gives the logic type, and which of the operands are written.
  * @returns true (and writes to `instruction`) if and only if parsing succeeds
  */
-static bool parse_logical(char **src, Instruction *instruction) {
+static bool parse_logical(char **src, const Mnemonic *mnemonic, Instruction *instruction,
+                          uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table,
+                          ParseError *error) {
     Instruction inst = *instruction;
     char *s = *src;
     bool is_valid;
-    // Reverse the logic types so that no substrings are checked before the actual string.
-    const char * const rev_logic_types[] = { "bics", "ands", "eon", "eor", "orn", "orr", "bic", "and", NULL };
-
-    int logic_type_int;
-    LogicType logic_type;
+    LogicType logic_type = mnemonic->opc;
 
     // The boolean values determine whether the corresponding register will be read.
     // For aliases, some registers are zero, and so the register will not need to have a value parsed.
@@ -463,29 +465,27 @@ static bool parse_logical(char **src, Instruction *instruction) {
     inst.dp_reg.opr = 0;
     inst.dp_reg.operand = 0;
 
-    if (parse_from(&s, rev_logic_types, &logic_type_int)) {
-        // reverse logic_type: remove NULL termination when measuring count
-        logic_type_int = ARRAY_LEN(rev_logic_types) - 2 - logic_type_int;
-        logic_type = (LogicType) logic_type_int;
-        rd_bool = rn_bool = op2_bool = true;
-    } else if (match_string(&s, "mvn")) {
-        // "mvn rd, <op2>" is an alias for "orn rd, rzr, <op2>"
-        // set zero register
-        inst.dp_reg.rn = ZERO_REG_INDEX;
-        logic_type = ORN; 
-        rd_bool = op2_bool = true;
-    } else if (match_string(&s, "mov")) {
-        // "mov rd, rm" is an alias for "orr rd, rzr, rm"
-        // since there is no op2, set zero register and zero shift
-        inst.dp_reg.rn = ZERO_REG_INDEX;
-        logic_type = ORR; 
-        rd_bool = rm_bool = true;
-    } else if (match_string(&s, "tst")) {
-        // "tst rn, <op2>" is an alias for "ands rzr, rn, <op2>"
-        inst.rd = ZERO_REG_INDEX;
-        logic_type = ANDS;
-        rn_bool = op2_bool = true;
-    } else return false;
+    switch (mnemonic->form) {
+        case LOGIC_MVN:
+            // "mvn rd, <op2>" is an alias for "orn rd, rzr, <op2>"
+            // set zero register
+            inst.dp_reg.rn = ZERO_REG_INDEX;
+            rd_bool = op2_bool = true;
+            break;
+        case LOGIC_MOV:
+            // "mov rd, rm" is an alias for "orr rd, rzr, rm"
+            // since there is no op2, set zero register and zero shift
+            inst.dp_reg.rn = ZERO_REG_INDEX;
+            rd_bool = rm_bool = true;
+            break;
+        case LOGIC_TST:
+            // "tst rn, <op2>" is an alias for "ands rzr, rn, <op2>"
+            inst.rd = ZERO_REG_INDEX;
+            rn_bool = op2_bool = true;
+            break;
+        default:
+            rd_bool = rn_bool = op2_bool = true;
+    }
 
     RegisterWidth cur_width;
     uint8_t rn = inst.dp_reg.rn;
@@ -512,7 +512,9 @@ static bool parse_logical(char **src, Instruction *instruction) {
     return true;
 }
 
-static bool parse_mov_dp_imm(char **src, Instruction *instruction) {
+static bool parse_mov_dp_imm(char **src, const Mnemonic *mnemonic, Instruction *instruction,
+                             uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table,
+                             ParseError *error) {
     // movk, movn, movz
     // <Rd>, #<imm>{, lsl #<imm>}
 
@@ -520,13 +522,7 @@ static bool parse_mov_dp_imm(char **src, Instruction *instruction) {
     Instruction inst = { .command_format = DP_IMM };
     inst.dp_imm.operand_type = WIDE_MOVE_OPERAND;
     // write data from mnemonic
-
-    bool valid_mnemonic = true;
-    inst.opc = match_string(&s, "movn") ? 0
-             : match_string(&s, "movz") ? 2
-             : match_string(&s, "movk") ? 3
-             : (valid_mnemonic = false);
-    if (!valid_mnemonic) return false;
+    inst.opc = mnemonic->opc;
 
     // set the registers not included in the string
 
@@ -560,7 +556,9 @@ static bool parse_mov_dp_imm(char **src, Instruction *instruction) {
 }
 
 
-static bool parse_mul(char **src, Instruction *instruction) {
+static bool parse_mul(char **src, const Mnemonic *mnemonic, Instruction *instruction,
+                      uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table,
+                      ParseError *error) {
     // <Rd>, <Rn>, <Rm>, <Ra>
 
     char *s = *src;
@@ -569,12 +567,7 @@ static bool parse_mul(char **src, Instruction *instruction) {
                          .dp_reg.m = 1 };
 
     // save data from mnemonic
-    char x;
-    if (match_string(&s, "madd") || match_string(&s, "mul")) {
-        x = 0;
-    } else if (match_string(&s, "msub") || match_string(&s, "mneg")) {
-        x = 1;
-    } else { return false; }
+    char x = mnemonic->opc;
 
     // check instruction string for data
     RegisterWidth rd_width;
@@ -615,155 +608,184 @@ static bool parse_mul(char **src, Instruction *instruction) {
     return true;
 }
 
-static bool parse_offset_type(
-    char **src,
+// the range of the signed offset of pre- and post-index addressing, which is 9 bits
+#define SIMM9_MIN (-(1L << 8))
+#define SIMM9_MAX ((1L << 8) - 1)
+
+/** Records an error at a token, unless an earlier error has been recorded.
+ * @returns false, so that a failed parse can return the result directly
+ */
+static bool token_error(ParseError *error, const Token *token, const char *message) {
+    if (error->message == NULL) {
+        error->message = message;
+        error->at = token->start;
+    }
+    return false;
+}
+
+/** Parses the address of a single data transfer, or a literal for a load literal,
+ * from the tokens starting at `tokens`. It takes one of the forms:
+ * [Xn, Xm]       register offset
+ * [Xn], #simm    post-index
+ * [Xn, #simm]!   pre-index
+ * [Xn, #imm]     unsigned offset, where imm is scaled by the width of Rt
+ * [Xn]           unsigned offset of zero
+ * literal        a label or address, for a load literal
+ * Each token is looked at once, and the form is chosen by the first token that differs.
+ * @returns true (and writes to `instruction`) if and only if the tokens match a form,
+ * and records the first token that does not match in `error` otherwise
+ */
+static bool parse_address(
+    const Token *tokens,
     Instruction *instruction,
     uint32_t cur_pos,
     SymbolTable known_table,
-    SymbolTable unknown_table
+    SymbolTable unknown_table,
+    ParseError *error
 ) {
-    char *s = *src;
-
-    uint8_t offset_xn;
-    RegisterWidth xn_width;
-    uint8_t offset_xm;
-    RegisterWidth xm_width;
-
-    int32_t simm = 0;
-    uint32_t imm = 0;
-
     Instruction inst = *instruction;
-    inst.command_format = SINGLE_DATA_TRANSFER;
-    inst.single_data_transfer.u = 0;
+    SDTOffsetType offset_type;
+    const Token *t = tokens;
 
-    // register offset: [<Xn>, <Xm>]
-    if (match_char(&s, '[')
-        && parse_reg(&s, &offset_xn, &xn_width)
-        && skip_comma(&s)
-        && parse_reg(&s, &offset_xm, &xm_width)
-        && match_char(&s, ']')
-        && xn_width == xm_width) {
-        inst.single_data_transfer.xn = offset_xn;
-        inst.single_data_transfer.offset.xm = offset_xm;
-        inst.single_data_transfer.offset_type = REGISTER_OFFSET;
-        *instruction = inst;
-        *src = s;
-        return true;
-    }
-    // reset unconsumed input
-    s = *src;
-    // post-index offset: [<Xn>], #<simm>
-    if (match_char(&s, '[')
-        && parse_reg(&s, &offset_xn, &xn_width)
-        && match_char(&s, ']')
-        && skip_comma(&s)
-        && match_char(&s, '#')
-        && parse_signed_immediate(&s, &simm)) {
-        inst.single_data_transfer.xn = offset_xn;
-        if (INT16_MIN <= simm && simm <= INT16_MAX) {
-            inst.single_data_transfer.offset.simm9 = (int16_t) simm;
-        } else return false;
-        inst.single_data_transfer.offset_type = POST_INDEX_OFFSET;
-        // ldr w0 [xn], #imm - post index
-        *instruction = inst;
-        *src = s;
-        return true;
-    }
-    s = *src;
-    // pre-index offset: [<Xn>, #<simm>]!
-    if (match_char(&s, '[')
-        && parse_reg(&s, &offset_xn, &xn_width)
-        && skip_comma(&s)
-        && match_char(&s, '#')
-        && parse_signed_immediate(&s, &simm)
-        && match_char(&s, ']')
-        && match_char(&s, '!')) {
-        inst.single_data_transfer.xn = offset_xn;
-        inst.single_data_transfer.offset.simm9 = simm;
-        inst.single_data_transfer.offset_type = PRE_INDEX_OFFSET;
-        // ldr w0 [xn, #imm]! - pre index
-        *instruction = inst;
-        *src = s;
-        return true;
-    }
-    s = *src;
-    // unsigned offset [<Xn>, #<imm>]
-    if (match_char(&s, '[')
-        && parse_reg(&s, &offset_xn, &xn_width)
-        && skip_comma(&s)
-        && match_char(&s, '#')
-        && parse_immediate(&s, &imm)
-        && match_char(&s, ']')) {
-        inst.single_data_transfer.xn = offset_xn;
-        uint16_t *imm12 = &inst.single_data_transfer.offset.imm12;
-        *imm12 = (xn_width == _64_BIT) ? imm / 8 : imm / 4;
-        inst.single_data_transfer.offset_type = UNSIGNED_OFFSET;
-        inst.single_data_transfer.u = 1;
-        // ldr w0 [xn #imm] - unsigned offset
-        *instruction = inst;
-        *src = s;
-        return true;
-    }
-    s = *src;
-    // unsigned offset [Xn]
-    if (match_char(&s, '[')
-        && parse_reg(&s, &offset_xn, &xn_width)
-        && match_char(&s, ']')) {
-        inst.single_data_transfer.xn = offset_xn;
-        inst.single_data_transfer.offset.imm12 = 0;
-        inst.single_data_transfer.offset_type = UNSIGNED_OFFSET;
-        inst.single_data_transfer.u = 1;
-        *instruction = inst;
-        *src = s;
-        return true;
-    }
-    s = *src;
-    // load literal or immediate address
-    inst.command_format = LOAD_LITERAL;
-    if (parse_literal(&s, cur_pos, &inst, known_table, unknown_table)) {
+    if (t->type != TOKEN_LBRACKET) {
+        // load literal or immediate address
+        if (t->type != TOKEN_WORD && t->type != TOKEN_NUMBER && t->type != TOKEN_REGISTER) {
+            return token_error(error, t, "expected an address or label");
+        }
+        if (t[1].type != TOKEN_END) return token_error(error, &t[1], "expected end of line");
+        inst.command_format = LOAD_LITERAL;
+        char *literal = (char *) t->start;
+        if (!parse_literal(&literal, cur_pos, &inst, known_table, unknown_table)) {
+            return token_error(error, t, "failed to record the label");
+        }
         *instruction = inst;
-        *src = s;
         return true;
     }
-    return false;
-}
 
-static bool parse_load_store(char **src, Instruction *instruction, uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table) {
-    char *s = *src;
-    Instruction inst = { .command_format = SINGLE_DATA_TRANSFER };
-    inst.single_data_transfer.u = 0;
+    t++;
+    if (t->type != TOKEN_REGISTER) return token_error(error, t, "expected a base register");
+    inst.command_format = SINGLE_DATA_TRANSFER;
+    inst.single_data_transfer.xn = t->data.reg.index;
+    RegisterWidth xn_width = t->data.reg.width;
+    t++;
+    switch (t->type) {
+        case TOKEN_RBRACKET:
+            t++;
+            if (t->type == TOKEN_END) {
+                // [Xn]
+                offset_type = UNSIGNED_OFFSET;
+                inst.single_data_transfer.offset.imm12 = 0;
+                break;
+            }
+            // [Xn], #simm
+            if (t->type != TOKEN_COMMA) return token_error(error, t, "expected ',' or end of line");
+            t++;
+            if (t->type != TOKEN_IMMEDIATE) return token_error(error, t, "expected an immediate offset");
+            if (t->data.value < SIMM9_MIN || t->data.value > SIMM9_MAX) {
+                return token_error(error, t, "offset must be from -256 to 255");
+            }
+            offset_type = POST_INDEX_OFFSET;
+            inst.single_data_transfer.offset.simm9 = t->data.value;
+            t++;
+            break;
+        case TOKEN_COMMA:
+            t++;
+            if (t->type == TOKEN_REGISTER) {
+                // [Xn, Xm]
+                if (t->data.reg.width != xn_width) {
+                    return token_error(error, t, "expected a register of the same width");
+                }
+                offset_type = REGISTER_OFFSET;
+                inst.single_data_transfer.offset.xm = t->data.reg.index;
+                t++;
+                if (t->type != TOKEN_RBRACKET) return token_error(error, t, "expected ']'");
+                t++;
+                break;
+            }
+            if (t->type != TOKEN_IMMEDIATE) return token_error(error, t, "expected a register or immediate offset");
+            const Token *offset = t++;
+            if (t->type != TOKEN_RBRACKET) return token_error(error, t, "expected ']'");
+            t++;
+            if (t->type == TOKEN_BANG) {
+                // [Xn, #simm]!
+                if (offset->data.value < SIMM9_MIN || offset->data.value > SIMM9_MAX) {
+                    return token_error(error, offset, "offset must be from -256 to 255");
+                }
+                offset_type = PRE_INDEX_OFFSET;
+                inst.single_data_transfer.offset.simm9 = offset->data.value;
+                t++;
+            } else {
+                // [Xn, #imm], scaled by the number of bytes transferred
+                int64_t scale = inst.sf == _64_BIT ? 8 : 4;
+                if (offset->data.value < 0 || offset->data.value / scale > IMM12_MAX) {
+                    return token_error(error, offset, "offset must be from 0 to 4095 times the register size");
+                }
+                if (offset->data.value % scale != 0) {
+                    return token_error(error, offset, "offset must be a multiple of the register size");
+                }
+                offset_type = UNSIGNED_OFFSET;
+                inst.single_data_transfer.offset.imm12 = offset->data.value / scale;
+            }
+            break;
+        default:
+            return token_error(error, t, "expected ']' or ','");
+    }
+    if (t->type != TOKEN_END) return token_error(error, t, "expected end of line");
 
-    if (match_string(&s, "ldr")) {
-        inst.single_data_transfer.l = 1;
-    } else if (match_string(&s, "str")) {
-        inst.single_data_transfer.l = 0;
-    } else return false;
+    inst.single_data_transfer.offset_type = offset_type;
+    inst.single_data_transfer.u = offset_type == UNSIGNED_OFFSET;
+    *instruction = inst;
+    return true;
+}
 
-    bool is_valid = skip_whitespace(&s)
-                    && parse_reg(&s, &inst.rt, &inst.sf)
-                    && skip_comma(&s)
-                    && parse_offset_type(&s, &inst, cur_pos, known_table, unknown_table);
+/** Parses the operands of a load or store, a line of the form
+ * [ldr|str] Rt, <address>
+ * The operands are split into tokens once, and matched in one pass.
+ * @returns true (and writes to `instruction`) if and only if parsing succeeds
+ */
+static bool parse_load_store(char **src, const Mnemonic *mnemonic, Instruction *instruction,
+                             uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table,
+                             ParseError *error) {
+    Token tokens[MAX_TOKENS];
+    const char *error_at;
+    if (!isspace((unsigned char) **src)) return false;
+    if (!lex_operands(*src, tokens, &error_at)) {
+        if (error->message == NULL) {
+            error->message = "unexpected character";
+            error->at = error_at;
+        }
+        return false;
+    }
 
-    if (!is_valid) return false;
-    *src = s;
+    Instruction inst = { .command_format = SINGLE_DATA_TRANSFER };
+    inst.single_data_transfer.l = mnemonic->opc;
+    if (tokens[0].type != TOKEN_REGISTER) return token_error(error, &tokens[0], "expected a register");
+    inst.rt = tokens[0].data.reg.index;
+    inst.sf = tokens[0].data.reg.width;
+    if (tokens[1].type != TOKEN_COMMA) return token_error(error, &tokens[1], "expected ','");
+    if (!parse_address(&tokens[2], &inst, cur_pos, known_table, unknown_table, error)) return false;
+
+    // the whole line has been consumed
+    *src += strlen(*src);
     *instruction = inst;
     return true;
 }
 
-static bool parse_b(char **src, Instruction *instruction, uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table) {
+static bool parse_b(char **src, const Mnemonic *mnemonic, Instruction *instruction,
+                    uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table,
+                    ParseError *error) {
     // <literal>
     char *s = *src;
     // write data we know from precondition
     Instruction inst = { .command_format = BRANCH };
 
-    int mnemonic_index;
-    if (match_string(&s, "b.") && parse_from(&s, branch_conds, &mnemonic_index)) {
+    if (mnemonic->form == BRANCH_COND) {
         inst.branch.operand_type = COND_BRANCH;
-        // map the mnemonic to the integer representation in the Instruction
-        inst.branch.operand.cond_branch.cond = cond_map[mnemonic_index];
-    } else if (match_string(&s, "b")) {
+        // map the index of the condition in branch_conds to the integer representation in the Instruction
+        inst.branch.operand.cond_branch.cond = cond_map[mnemonic->opc];
+    } else {
         inst.branch.operand_type = UNCOND_BRANCH;
-    } else return false;
+    }
     if (!skip_whitespace(&s)) return false;
 
     bool literal_valid = parse_literal(&s, cur_pos, &inst, known_table, unknown_table);
@@ -774,12 +796,12 @@ static bool parse_b(char **src, Instruction *instruction, uint32_t cur_pos, Symb
     return true;
 }
 
-static bool parse_br(char **src, Instruction *instruction) {
+static bool parse_br(char **src, const Mnemonic *mnemonic, Instruction *instruction,
+                     uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table,
+                     ParseError *error) {
     char *s = *src;
     Instruction inst = { .command_format = BRANCH, .branch.operand_type = REGISTER_BRANCH };
-    // check we're on the right mnemonic
-    bool is_br = match_string(&s, "br")
-              && skip_whitespace(&s)
+    bool is_br = skip_whitespace(&s)
               && parse_reg(&s, &inst.branch.operand.register_branch.xn, &inst.sf);
     if (!is_br) return false;
     *src = s;
@@ -815,17 +837,98 @@ bool parse_directive(char **src, int32_t *dest) {
     return true;
 }
 
-bool parse_instruction(char **src, Instruction *instruction, uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table) {
+/* Mnemonics are looked up in a perfect hash table: no two of them hash to the
+ * same slot, so a lookup is one hash and one string comparison. The hash mixes
+ * the first three characters (zero past the end), the last character and the
+ * length, with coefficients searched for to separate every mnemonic.
+ * The table is written with designated initializers, and a mnemonic added to
+ * the table that collides with another one fails to compile. */
+#define MNEMONIC_TABLE_SIZE 64
+#define MAX_MNEMONIC_LEN    4
+#define MNEMONIC_HASH(c0, c1, c2, last, len) \
+    ((8 * (c0) + 25 * (c1) + 63 * (c2) + 11 * (last) + 14 * (len)) & (MNEMONIC_TABLE_SIZE - 1))
+
+#define MNEMONIC1(a, parse, opc, form) \
+    [MNEMONIC_HASH(a, 0, 0, a, 1)] = { (char []) { a, '\0' }, parse, opc, form }
+#define MNEMONIC2(a, b, parse, opc, form) \
+    [MNEMONIC_HASH(a, b, 0, b, 2)] = { (char []) { a, b, '\0' }, parse, opc, form }
+#define MNEMONIC3(a, b, c, parse, opc, form) \
+    [MNEMONIC_HASH(a, b, c, c, 3)] = { (char []) { a, b, c, '\0' }, parse, opc, form }
+#define MNEMONIC4(a, b, c, d, parse, opc, form) \
+    [MNEMONIC_HASH(a, b, c, d, 4)] = { (char []) { a, b, c, d, '\0' }, parse, opc, form }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic error "-Woverride-init"
+static const Mnemonic mnemonics[MNEMONIC_TABLE_SIZE] = {
+    MNEMONIC3('a', 'd', 'd',      parse_add_sub,    ADD,  ARITH_RD_RN),
+    MNEMONIC4('a', 'd', 'd', 's', parse_add_sub,    ADDS, ARITH_RD_RN),
+    MNEMONIC3('s', 'u', 'b',      parse_add_sub,    SUB,  ARITH_RD_RN),
+    MNEMONIC4('s', 'u', 'b', 's', parse_add_sub,    SUBS, ARITH_RD_RN),
+    MNEMONIC3('c', 'm', 'p',      parse_add_sub,    SUBS, ARITH_RN),
+    MNEMONIC3('c', 'm', 'n',      parse_add_sub,    ADDS, ARITH_RN),
+    MNEMONIC3('n', 'e', 'g',      parse_add_sub,    SUB,  ARITH_RD),
+    MNEMONIC4('n', 'e', 'g', 's', parse_add_sub,    SUBS, ARITH_RD),
+    MNEMONIC3('a', 'n', 'd',      parse_logical,    AND,  LOGIC_RD_RN),
+    MNEMONIC4('a', 'n', 'd', 's', parse_logical,    ANDS, LOGIC_RD_RN),
+    MNEMONIC3('b', 'i', 'c',      parse_logical,    BIC,  LOGIC_RD_RN),
+    MNEMONIC4('b', 'i', 'c', 's', parse_logical,    BICS, LOGIC_RD_RN),
+    MNEMONIC3('e', 'o', 'r',      parse_logical,    EOR,  LOGIC_RD_RN),
+    MNEMONIC3('e', 'o', 'n',      parse_logical,    EON,  LOGIC_RD_RN),
+    MNEMONIC3('o', 'r', 'r',      parse_logical,    ORR,  LOGIC_RD_RN),
+    MNEMONIC3('o', 'r', 'n',      parse_logical,    ORN,  LOGIC_RD_RN),
+    MNEMONIC3('t', 's', 't',      parse_logical,    ANDS, LOGIC_TST),
+    MNEMONIC3('m', 'v', 'n',      parse_logical,    ORN,  LOGIC_MVN),
+    MNEMONIC3('m', 'o', 'v',      parse_logical,    ORR,  LOGIC_MOV),
+    MNEMONIC4('m', 'o', 'v', 'n', parse_mov_dp_imm, 0,    NO_FORM),
+    MNEMONIC4('m', 'o', 'v', 'z', parse_mov_dp_imm, 2,    NO_FORM),
+    MNEMONIC4('m', 'o', 'v', 'k', parse_mov_dp_imm, 3,    NO_FORM),
+    MNEMONIC4('m', 'a', 'd', 'd', parse_mul,        0,    NO_FORM),
+    MNEMONIC3('m', 'u', 'l',      parse_mul,        0,    NO_FORM),
+    MNEMONIC4('m', 's', 'u', 'b', parse_mul,        1,    NO_FORM),
+    MNEMONIC4('m', 'n', 'e', 'g', parse_mul,        1,    NO_FORM),
+    MNEMONIC3('l', 'd', 'r',      parse_load_store, 1,    NO_FORM),
+    MNEMONIC3('s', 't', 'r',      parse_load_store, 0,    NO_FORM),
+    MNEMONIC1('b',                parse_b,          0,    BRANCH_UNCOND),
+    MNEMONIC4('b', '.', 'e', 'q', parse_b,          0,    BRANCH_COND),
+    MNEMONIC4('b', '.', 'n', 'e', parse_b,          1,    BRANCH_COND),
+    MNEMONIC4('b', '.', 'g', 'e', parse_b,          2,    BRANCH_COND),
+    MNEMONIC4('b', '.', 'l', 't', parse_b,          3,    BRANCH_COND),
+    MNEMONIC4('b', '.', 'g', 't', parse_b,          4,    BRANCH_COND),
+    MNEMONIC4('b', '.', 'l', 'e', parse_b,          5,    BRANCH_COND),
+    MNEMONIC4('b', '.', 'a', 'l', parse_b,          6,    BRANCH_COND),
+    MNEMONIC2('b', 'r',           parse_br,         0,    NO_FORM),
+};
+#pragma GCC diagnostic pop
+
+/** Reads the mnemonic at the start of src, a run of letters and dots, and looks it up.
+ * @returns the mnemonic, advancing src past it, or `NULL` if it is not a known mnemonic
+ */
+static const Mnemonic *parse_mnemonic(char **src) {
+    char *s = *src;
+    size_t len = 0;
+    while (isalpha((unsigned char) s[len]) || s[len] == '.') {
+        if (++len > MAX_MNEMONIC_LEN) return NULL;
+    }
+    if (len == 0) return NULL;
+    unsigned char c0 = s[0];
+    unsigned char c1 = len > 1 ? s[1] : 0;
+    unsigned char c2 = len > 2 ? s[2] : 0;
+    const Mnemonic *mnemonic = &mnemonics[MNEMONIC_HASH(c0, c1, c2, (unsigned char) s[len - 1], len)];
+    if (mnemonic->name == NULL
+        || strncmp(mnemonic->name, s, len) != 0
+        || mnemonic->name[len] != '\0') return NULL;
+    *src = s + len;
+    return mnemonic;
+}
+
+bool parse_instruction(char **src, Instruction *instruction, uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table,
+                       ParseError *error) {
     char *s = *src;
     Instruction inst;
-    bool is_instr = parse_add_sub(&s, &inst)
-                    || parse_logical(&s, &inst)
-                    || parse_mov_dp_imm(&s, &inst)
-                    || parse_mul(&s, &inst)
-                    || parse_load_store(&s, &inst, cur_pos, known_table, unknown_table)
-                    || parse_b(&s, &inst, cur_pos, known_table, unknown_table)
-                    || parse_br(&s, &inst);
-    if (!is_instr) return false;
+    // the mnemonic is read once, and selects the only handler that can parse the line
+    const Mnemonic *mnemonic = parse_mnemonic(&s);
+    if (mnemonic == NULL
+        || !mnemonic->parse(&s, mnemonic, &inst, cur_pos, known_table, unknown_table, error)) return false;
     *src = s;
     *instruction = inst;
     return true;
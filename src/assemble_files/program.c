@@ -0,0 +1,202 @@
+/* Implementation for the lines of a program.
+ * This is an arena of fixed-size chunks of lines, indexed through a directory of chunk pointers,
+ * and a sorted array of the lines still waiting on a forward reference when streaming. */
+
+#include "../headers/program.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CHUNK_BITS 10
+#define CHUNK_LEN  (0x1UL << CHUNK_BITS) // 2^10 = 1024 lines per chunk
+#define INITIAL_NUM_CHUNKS 4
+#define INITIAL_NUM_PENDING 64
+
+/**
+ * A structure representing a growable program.
+ * Growing only ever reallocates the directory, which holds a pointer per chunk, and never the lines themselves.
+ * @property chunks a basal pointer to an array of `capacity` chunk pointers, of which `num_chunks` are allocated
+ * @property num_chunks the number of chunks allocated
+ * @property capacity the number of chunk pointers the directory can hold
+ * @property size the number of lines in the program
+ */
+struct program {
+    ProgramLine **chunks;
+    uint32_t num_chunks;
+    uint32_t capacity;
+    uint32_t size;
+};
+
+/** Creates an empty program.
+ * @returns the program, or `NULL` if memory allocation fails
+ */
+Program program_new(void) {
+    Program program = malloc(sizeof(struct program));
+    if (program == NULL) return NULL;
+    ProgramLine **chunks = malloc(sizeof(ProgramLine *) * INITIAL_NUM_CHUNKS);
+    if (chunks == NULL) {
+        free(program);
+        return NULL;
+    }
+    *program = (struct program) { .chunks = chunks, .num_chunks = 0, .capacity = INITIAL_NUM_CHUNKS, .size = 0 };
+    return program;
+}
+
+/** Frees the program, including every chunk of lines.
+ * @param program the program to be unallocated from memory
+ */
+void program_free(Program program) {
+    for (uint32_t i = 0; i < program->num_chunks; i++) {
+        free(program->chunks[i]);
+    }
+    free(program->chunks);
+    free(program);
+}
+
+/** Returns the number of lines in the program.
+ * @param program the given program
+ */
+uint32_t program_size(Program program) {
+    return program->size;
+}
+
+/** Returns a pointer to the line at a given position.
+ * A precondition is that the position is below the size of the program.
+ * @param program the given program
+ * @param pos the index of the line
+ */
+ProgramLine *program_line(Program program, uint32_t pos) {
+    return &program->chunks[pos >> CHUNK_BITS][pos & (CHUNK_LEN - 1)];
+}
+
+/** Adds a line to the end of the program, allocating a new chunk if the last one is full.
+ * @param program the program to add to
+ * @returns a pointer to the uninitialised line, or `NULL` if memory allocation fails
+ */
+ProgramLine *program_append(Program program) {
+    if (program->size == program->num_chunks * CHUNK_LEN) {
+        if (program->num_chunks == program->capacity) {
+            ProgramLine **chunks = realloc(program->chunks, sizeof(ProgramLine *) * program->capacity * 2);
+            if (chunks == NULL) return NULL;
+            program->chunks = chunks;
+            program->capacity *= 2;
+        }
+        ProgramLine *chunk = malloc(sizeof(ProgramLine) * CHUNK_LEN);
+        if (chunk == NULL) return NULL;
+        program->chunks[program->num_chunks++] = chunk;
+    }
+    return program_line(program, program->size++);
+}
+
+/**
+ * A structure representing an instruction waiting on a forward reference.
+ * @property pos the index of the instruction in the program
+ * @property live `false` once the instruction has been resolved and removed
+ * @property inst the instruction, whose offset is set when its label is found
+ */
+typedef struct {
+    uint32_t pos;
+    bool live;
+    Instruction inst;
+} PendingLine;
+
+/**
+ * A structure representing the pending lines of a streamed program, sorted by position.
+ * Lines are added in increasing position, so adding appends. Removed lines are left in place until
+ * the array fills, and are then compacted away, so it holds at most twice the number of live lines.
+ * @property lines a basal pointer to an array of `capacity` lines, of which `size` are in use
+ * @property size the number of lines in use, both live and removed
+ * @property capacity the number of lines the array can hold
+ * @property num_live the number of lines not yet removed
+ */
+struct pending {
+    PendingLine *lines;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t num_live;
+};
+
+/** Creates an empty set of pending lines.
+ * @returns the pending lines, or `NULL` if memory allocation fails
+ */
+PendingLines pending_new(void) {
+    PendingLines pending = malloc(sizeof(struct pending));
+    if (pending == NULL) return NULL;
+    *pending = (struct pending) { .lines = NULL, .size = 0, .capacity = 0, .num_live = 0 };
+    return pending;
+}
+
+/** Frees the pending lines.
+ * @param pending the pending lines to be unallocated from memory
+ */
+void pending_free(PendingLines pending) {
+    free(pending->lines);
+    free(pending);
+}
+
+/** Adds an instruction waiting on a forward reference.
+ * A precondition is that `pos` is greater than the position of every line added before.
+ * @param pending the pending lines to add to
+ * @param pos the index of the instruction in the program
+ * @param inst the instruction, which is copied
+ * @returns `true` if addition succeeded, and `false` if memory allocation fails
+ */
+bool pending_add(PendingLines pending, uint32_t pos, const Instruction *inst) {
+    if (pending->size == pending->capacity) {
+        if (pending->num_live <= pending->size / 2 && pending->size > 0) {
+            // compact the live lines to the front, keeping their order
+            uint32_t live = 0;
+            for (uint32_t i = 0; i < pending->size; i++) {
+                if (pending->lines[i].live) pending->lines[live++] = pending->lines[i];
+            }
+            pending->size = live;
+        } else {
+            uint32_t capacity = pending->capacity == 0 ? INITIAL_NUM_PENDING : pending->capacity * 2;
+            PendingLine *lines = realloc(pending->lines, sizeof(PendingLine) * capacity);
+            if (lines == NULL) return false;
+            pending->lines = lines;
+            pending->capacity = capacity;
+        }
+    }
+    pending->lines[pending->size++] = (PendingLine) { .pos = pos, .live = true, .inst = *inst };
+    pending->num_live++;
+    return true;
+}
+
+/** Performs binary search to find the line at a given position.
+ * @param pending the pending lines to be searched through
+ * @param pos the index of the instruction in the program
+ * @returns a pointer to the line, or `NULL` if no line, live or removed, is at that position
+ */
+static PendingLine *pending_find(PendingLines pending, uint32_t pos) {
+    uint32_t low = 0, high = pending->size;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (pending->lines[mid].pos < pos) low = mid + 1;
+        else high = mid;
+    }
+    return (low < pending->size && pending->lines[low].pos == pos) ? &pending->lines[low] : NULL;
+}
+
+/** Returns a pointer to the pending instruction at a given position.
+ * The pointer is valid until the next line is added.
+ * @param pending the pending lines to be searched through
+ * @param pos the index of the instruction in the program
+ * @returns a pointer to the instruction, or `NULL` if it is not pending
+ */
+Instruction *pending_get(PendingLines pending, uint32_t pos) {
+    PendingLine *line = pending_find(pending, pos);
+    return (line != NULL && line->live) ? &line->inst : NULL;
+}
+
+/** Removes the pending instruction at a given position, if there is one.
+ * @param pending the pending lines to be modified
+ * @param pos the index of the instruction in the program
+ */
+void pending_remove(PendingLines pending, uint32_t pos) {
+    PendingLine *line = pending_find(pending, pos);
+    if (line == NULL || !line->live) return;
+    line->live = false;
+    // once nothing is pending, the array can be reused from the start
+    if (--pending->num_live == 0) pending->size = 0;
+}
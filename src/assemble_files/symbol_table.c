@@ -8,7 +8,7 @@
 #include <stdbool.h>
 #include <string.h>
 
-#define MAX_NUM_BUCKETS (0x1UL << 15) // 2^15 = 32768 buckets
+#define MAX_NUM_BUCKETS (0x1UL << 24) // 2^24 = 16777216 buckets
 
 /**
  * A structure representing an entry in a bucket.
@@ -36,7 +36,7 @@ struct bucket {
  * A structure representing a resizing array of buckets.
  * The array attempts to resize when the number of entries exceeds the product of the number of buckets
  * and the load factor (the maximum average number of entries per bucket).
- * The maximum number of buckets is 2^16 (65536), and the number of buckets should always be a power of two
+ * The maximum number of buckets is 2^24 (16777216), and the number of buckets should always be a power of two
  * for hashing to work properly.
  * @property load_factor the maximum allowed average number of entries per bucket
  * @property buckets a basal pointer to an array of `Bucket`s
@@ -45,17 +45,17 @@ struct bucket {
 struct symtable {
     float load_factor;
     Bucket *buckets;
-    uint16_t size;
-    uint16_t num_buckets;
+    uint32_t size;
+    uint32_t num_buckets;
 };
 
 /** A hashing function used to index the symtable using the djb2 algorithm in the given link.
  * @param str the string to be hashed
- * @returns the hashed string, 16 bits in length
+ * @returns the hashed string, 32 bits in length
  * @see http://www.cse.yorku.ca/~oz/hash.html
  */
-static uint16_t string_hash(const char *str) {
-    uint16_t hash = 5381;
+static uint32_t string_hash(const char *str) {
+    uint32_t hash = 5381;
     for (int c; (c = *str++); hash = ((hash << 5) + hash) + c); // hash = hash * 33 + c
     return hash;
 }
@@ -147,11 +147,11 @@ static bool bucket_remove(Bucket *head_ptr, const char *key, uint32_t *dest) {
  * @returns the symbol table, or `NULL` if creation fails
  * @see symtable_new
  */
-static SymbolTable symtable_num_buckets(float load_factor, uint16_t num_buckets) {
+static SymbolTable symtable_num_buckets(float load_factor, uint32_t num_buckets) {
     if (load_factor <= 0) return NULL;
     // count the number of ones; it is one if and only if num_buckets is a power of two
     uint8_t num_ones = 0;
-    for (int i = 0; i < 16; i++) {
+    for (int i = 0; i < 32; i++) {
         num_ones += (num_buckets >> i) & 0x1;
     }
     if (num_ones != 1) return NULL;
@@ -191,6 +191,14 @@ bool symtable_empty(SymbolTable symtable) {
     return symtable->size == 0;
 }
 
+/** Returns the number of entries in a symbol table.
+ * For a multimap, each entry under a key is counted.
+ * @param symtable the given symbol table
+ */
+uint32_t symtable_size(SymbolTable symtable) {
+    return symtable->size;
+}
+
 /** Returns a pointer to an array of `symtable->size` entries in the symbol table
  * @param symtable the given symbol table
  * @returns an unsorted copy of the entries in the symtable, or `NULL` if memory allocation failed
@@ -198,8 +206,8 @@ bool symtable_empty(SymbolTable symtable) {
 static Entry *symtable_entries(SymbolTable symtable) {
     Entry *entries = malloc(sizeof(Entry) * symtable->size);
     if (entries == NULL) return NULL;
-    uint16_t i = 0;
-    for (uint16_t j = 0; j < symtable->num_buckets; j++) {
+    uint32_t i = 0;
+    for (uint32_t j = 0; j < symtable->num_buckets; j++) {
         for (Bucket b = symtable->buckets[j]; b != NULL; b = b->tail) {
             entries[i++] = b->entry;
         }
@@ -212,7 +220,7 @@ static Entry *symtable_entries(SymbolTable symtable) {
  * @param symtable the given symbol table
  */
 static void symtable_free_buckets(SymbolTable symtable) {
-    for (uint16_t i = 0; i < symtable->num_buckets; i++) {
+    for (uint32_t i = 0; i < symtable->num_buckets; i++) {
         bucket_free_all(symtable->buckets[i]);
     }
     free(symtable->buckets);
@@ -231,7 +239,7 @@ void symtable_free(SymbolTable symtable) {
  * @param symtable the symbol table to be indexed
  * @param key the string to be hashed
  */
-static uint16_t symtable_bucket_index(SymbolTable symtable, const char *key) {
+static uint32_t symtable_bucket_index(SymbolTable symtable, const char *key) {
     return string_hash(key) & (symtable->num_buckets - 1);
 }
 
@@ -241,7 +249,7 @@ static uint16_t symtable_bucket_index(SymbolTable symtable, const char *key) {
  * @returns `true` if an address is associated to the key in the map, and `false` otherwise
  */
 bool symtable_contains(SymbolTable symtable, const char *key) {
-    uint16_t bucket_index = symtable_bucket_index(symtable, key);
+    uint32_t bucket_index = symtable_bucket_index(symtable, key);
     return bucket_contains(symtable->buckets[bucket_index], key);
 }
 
@@ -253,7 +261,7 @@ bool symtable_contains(SymbolTable symtable, const char *key) {
  * @returns `true` if and only if an entry with the given key exists in the symbol table.
  */
 bool symtable_get(SymbolTable symtable, const char *key, uint32_t *dest) {
-    uint16_t bucket_index = symtable_bucket_index(symtable, key);
+    uint32_t bucket_index = symtable_bucket_index(symtable, key);
     return bucket_get(symtable->buckets[bucket_index], key, dest);
 }
 
@@ -267,7 +275,7 @@ bool symtable_get(SymbolTable symtable, const char *key, uint32_t *dest) {
  * @returns `true` if at least one entry was removed, and `false` if the symbol table was unmodified.
  */
 bool multi_symtable_remove_last(SymbolTable symtable, const char *key, uint32_t *dest) {
-    uint16_t bucket_index = symtable_bucket_index(symtable, key);
+    uint32_t bucket_index = symtable_bucket_index(symtable, key);
     Bucket *head_ptr = &symtable->buckets[bucket_index];
     if (bucket_remove(head_ptr, key, dest)) {
         symtable->size--;
@@ -320,14 +328,14 @@ static bool symtable_resize(SymbolTable symtable) {
         return false;
     }
     bool success = true;
-    for (int i = 0; i < symtable->size; i++) {
+    for (uint32_t i = 0; i < symtable->size; i++) {
         Entry e = entries[i];
         success = success && multi_symtable_add(new_table, e.label, e.address);
     }
     free(entries);
     if (!success) {
         // destroy the temporary table
-        symtable_free(symtable);
+        symtable_free(new_table);
         return false;
     } else {
         // clear the buckets in the old symbol table and copy the new ones over
@@ -347,7 +355,7 @@ static bool symtable_resize(SymbolTable symtable) {
  */
 bool multi_symtable_add(SymbolTable symtable, const char *key, const uint32_t address) {
     // add a new entry; resize if needed
-    uint16_t bucket_index = symtable_bucket_index(symtable, key);
+    uint32_t bucket_index = symtable_bucket_index(symtable, key);
     Bucket *head_ptr = &symtable->buckets[bucket_index];
     // include the nul character in the size to be allocated
     char *str = malloc((strlen(key) + 1) * sizeof(char));
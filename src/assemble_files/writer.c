@@ -0,0 +1,177 @@
+/* Implementation for the output writer.
+ * The output file is written with write and pwrite on its descriptor, never through stdio. */
+
+#include "../headers/writer.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define WORD_SIZE 4
+#define BUFFER_WORDS (0x1UL << 14) // 2^14 words = 64 KiB
+
+/**
+ * A structure representing the output file and the memory being written into it.
+ * @property fd the descriptor of the output file
+ * @property image the image of the whole file given by `writer_map`, or `NULL`
+ * @property image_size the size of the image in bytes
+ * @property mapped `true` if the image is mapped onto the file, and `false` if it was allocated
+ * @property num_flushed the number of words appended and written to the file
+ * @property num_buffered the number of words appended but still in the buffer
+ * @property buffer the words appended after the first `num_flushed`
+ */
+struct writer {
+    int fd;
+    uint8_t *image;
+    size_t image_size;
+    bool mapped;
+    uint32_t num_flushed;
+    uint32_t num_buffered;
+    uint8_t buffer[BUFFER_WORDS * WORD_SIZE];
+};
+
+/** Stores a word as four little-endian bytes.
+ * @param dest the address of the first byte
+ * @param word the word to be stored
+ */
+void put_word(uint8_t *dest, uint32_t word) {
+    dest[0] = word & 0xFF;
+    dest[1] = (word >> 8) & 0xFF;
+    dest[2] = (word >> 16) & 0xFF;
+    dest[3] = word >> 24;
+}
+
+/** Writes all of a block of bytes to the current position of a file, retrying short writes.
+ * @returns `true` if every byte was written, and `false` otherwise
+ */
+static bool write_all(int fd, const uint8_t *bytes, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+/** Creates a writer for an output file opened for reading and writing.
+ * @param output_file the output file, which should be empty
+ * @returns the writer, or `NULL` if memory allocation fails
+ */
+Writer writer_new(FILE *output_file) {
+    Writer writer = malloc(sizeof(struct writer));
+    if (writer == NULL) return NULL;
+    writer->fd = fileno(output_file);
+    writer->image = NULL;
+    writer->image_size = 0;
+    writer->mapped = false;
+    writer->num_flushed = 0;
+    writer->num_buffered = 0;
+    return writer;
+}
+
+/** Frees the writer, releasing any image without writing it.
+ * @param writer the writer to be unallocated from memory
+ */
+void writer_free(Writer writer) {
+    if (writer->image != NULL) {
+        if (writer->mapped) munmap(writer->image, writer->image_size);
+        else free(writer->image);
+    }
+    free(writer);
+}
+
+/** Returns an image of an output file of a given number of words, to be filled in and then written by `writer_unmap`.
+ * The file's blocks are reserved in advance and mapped into memory, so that the words are written as they are stored,
+ * and a full disk is reported here rather than as a fault when the image is filled in.
+ * If the blocks cannot be reserved or the file cannot be mapped, for example if it is a pipe,
+ * the image is a buffer written in one go instead.
+ * @param writer the writer of the output file
+ * @param num_words the number of words in the file
+ * @returns the address of the first byte of the image, or `NULL` if memory allocation fails
+ */
+uint8_t *writer_map(Writer writer, uint32_t num_words) {
+    size_t size = (size_t) num_words * WORD_SIZE;
+    writer->image_size = size;
+    bool reserved = size > 0 && posix_fallocate(writer->fd, 0, size) == 0;
+    if (reserved) {
+        void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd, 0);
+        if (mapping != MAP_FAILED) {
+            writer->image = mapping;
+            writer->mapped = true;
+            return writer->image;
+        }
+        // a file that cannot be mapped is written from the start instead
+        if (ftruncate(writer->fd, 0) != 0) return NULL;
+    }
+    writer->image = malloc(size > 0 ? size : 1);
+    writer->mapped = false;
+    return writer->image;
+}
+
+/** Writes the image given by `writer_map` to the output file, and releases it.
+ * A mapped image is left to the system to write back, as a buffered image is once it is written.
+ * @param writer the writer of the output file
+ * @returns `true` if the image was written, and `false` otherwise
+ */
+bool writer_unmap(Writer writer) {
+    bool success;
+    if (writer->mapped) {
+        success = munmap(writer->image, writer->image_size) == 0;
+    } else {
+        success = write_all(writer->fd, writer->image, writer->image_size);
+        free(writer->image);
+    }
+    writer->image = NULL;
+    return success;
+}
+
+/** Appends a word to the output file through the buffer, writing the buffer out when it fills.
+ * @param writer the writer of the output file
+ * @param word the word to be appended
+ * @returns `true` if appending succeeded, and `false` if writing the buffer fails
+ */
+bool writer_write(Writer writer, uint32_t word) {
+    if (writer->num_buffered == BUFFER_WORDS && !writer_flush(writer)) return false;
+    put_word(&writer->buffer[writer->num_buffered++ * WORD_SIZE], word);
+    return true;
+}
+
+/** Overwrites a word already appended to the output file.
+ * A word still in the buffer is patched in memory; otherwise, it is written in place in the file.
+ * @param writer the writer of the output file
+ * @param pos the index of the word among those appended
+ * @param word the new word
+ * @returns `true` if patching succeeded, and `false` if writing fails
+ */
+bool writer_patch(Writer writer, uint32_t pos, uint32_t word) {
+    if (pos >= writer->num_flushed) {
+        put_word(&writer->buffer[(pos - writer->num_flushed) * WORD_SIZE], word);
+        return true;
+    }
+    uint8_t bytes[WORD_SIZE];
+    put_word(bytes, word);
+    return pwrite(writer->fd, bytes, WORD_SIZE, (off_t) pos * WORD_SIZE) == WORD_SIZE;
+}
+
+/** Writes out the words in the buffer.
+ * @param writer the writer of the output file
+ * @returns `true` if writing succeeded, and `false` otherwise
+ */
+bool writer_flush(Writer writer) {
+    if (!write_all(writer->fd, writer->buffer, writer->num_buffered * WORD_SIZE)) return false;
+    writer->num_flushed += writer->num_buffered;
+    writer->num_buffered = 0;
+    return true;
+}
+
+/** Checks whether words already written out can be patched in place, as `writer_patch` needs.
+ * @param writer the writer of the output file
+ * @returns `true` if the output file is seekable, and `false` if it is something like a pipe
+ */
+bool writer_seekable(Writer writer) {
+    return lseek(writer->fd, 0, SEEK_CUR) >= 0;
+}
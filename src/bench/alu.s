@@ -0,0 +1,15 @@
+ldr w9, count
+movz x1, #0x1
+movz x2, #0x3
+alu_loop:
+add x3, x1, x2
+sub x4, x3, #0x7
+and x5, x3, x4
+orr x6, x5, x1, lsl #3
+eor x1, x6, x2, lsr #1
+add x2, x2, #0x5
+subs w9, w9, #0x1
+b.ne alu_loop
+and x0, x0, x0
+count:
+    .int 0x80000
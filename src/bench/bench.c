@@ -0,0 +1,257 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../headers/bench.h"
+#include "../headers/decode.h"
+#include "../headers/emulator.h"
+#include "../headers/encode.h"
+#include "../headers/symbol_table.h"
+#include "../headers/timing.h"
+
+// Number of times each measurement is repeated; the fastest run is reported.
+#define DEFAULT_REPETITIONS 3
+// Number of calls timed by each microbenchmark.
+#define MICRO_CALLS 10000000
+// Number of labels held by the symbol table microbenchmark, and the
+// number of times each is set and looked up.
+#define NUM_LABELS 1000
+#define SYMTABLE_ROUNDS 1000
+#define SYMTABLE_LOAD_FACTOR 2.0
+
+static const char *const mode_names[] = { [INTERPRET] = "interpret", [BLOCKS] = "blocks", [JIT] = "jit" };
+
+/*
+    Returns the time in seconds from an arbitrary fixed point.
+*/
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/*
+    Takes a kernel and an execution mode. Runs the kernel to completion,
+    discarding its output, and returns the seconds the run took.
+    If instructions is not NULL, it is set to the number of instructions
+    run, which are counted by the timing model.
+*/
+static double run_kernel(const char *kernel, ExecutionMode execution_mode, uint64_t *instructions) {
+    EmulatorConfig config = { .memory_size = MEMORY_SIZE, .execution_mode = execution_mode, .num_cores = 1 };
+    TimingModel model;
+    timing_default(&model);
+
+    Emulator *emulator = emulator_create(&config);
+    emulator_load(emulator, kernel);
+    emulator_set_output(emulator, "/dev/null");
+    if (instructions != NULL) {
+        emulator_set_timing(emulator, &model);
+    }
+
+    double start = now();
+    emulator_run(emulator);
+    double seconds = now() - start;
+
+    if (instructions != NULL) {
+        *instructions = 0;
+        for (int class = 0; class < NUM_INSTRUCTION_CLASSES; class++) {
+            *instructions += emulator->cores[0].class_counts[class];
+        }
+    }
+    emulator_destroy(emulator);
+    return seconds;
+}
+
+/*
+    Reports the throughput of the emulator on a kernel in each execution
+    mode, as millions of instructions per second and nanoseconds each.
+*/
+static void bench_kernel(const char *kernel, int repetitions) {
+    uint64_t instructions;
+    run_kernel(kernel, INTERPRET, &instructions);
+
+    for (ExecutionMode mode = INTERPRET; mode <= JIT; mode++) {
+        double best = run_kernel(kernel, mode, NULL);
+        for (int i = 1; i < repetitions; i++) {
+            double seconds = run_kernel(kernel, mode, NULL);
+            if (seconds < best) {
+                best = seconds;
+            }
+        }
+        printf("%-24s %-10s %12" PRIu64 " %10.3f %10.2f %10.2f\n", kernel, mode_names[mode],
+               instructions, best * 1e3, instructions / best / 1e6, best * 1e9 / instructions);
+    }
+}
+
+/*
+    Takes a list of binary files. Returns their words, setting num_words
+    to the number read.
+*/
+static uint32_t *read_words(char **files, int num_files, size_t *num_words) {
+    uint32_t *words = NULL;
+    size_t capacity = 0;
+    *num_words = 0;
+    for (int i = 0; i < num_files; i++) {
+        FILE *file = fopen(files[i], "rb");
+        if (file == NULL) {
+            fprintf(stderr, "bench: can't open %s, errno %d\n", files[i], errno);
+            exit(1);
+        }
+        unsigned char bytes[4];
+        while (fread(bytes, 1, 4, file) == 4) {
+            if (*num_words == capacity) {
+                capacity = capacity == 0 ? 256 : capacity * 2;
+                words = realloc(words, capacity * sizeof(uint32_t));
+                if (words == NULL) {
+                    fprintf(stderr, "bench: ran out of memory\n");
+                    exit(1);
+                }
+            }
+            words[(*num_words)++] = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+        }
+        fclose(file);
+    }
+    return words;
+}
+
+static void report_micro(const char *name, double seconds, uint64_t calls) {
+    printf("%-24s %12" PRIu64 " %10.3f %10.2f\n", name, calls, seconds * 1e3, seconds * 1e9 / calls);
+}
+
+/*
+    Times decode() over the instruction words of the kernels, and
+    encode() over the instructions that encode back to the same word.
+*/
+static void bench_codec(const uint32_t *words, size_t num_words, int repetitions) {
+    Instruction *insts = malloc(num_words * sizeof(Instruction));
+    if (insts == NULL) {
+        fprintf(stderr, "bench: ran out of memory\n");
+        exit(1);
+    }
+    // data words and HALT have no instruction to encode
+    size_t num_insts = 0;
+    for (size_t i = 0; i < num_words; i++) {
+        Instruction inst = decode(words[i]);
+        if (inst.command_format != UNKNOWN && inst.command_format != HALT && encode(&inst) == words[i]) {
+            insts[num_insts++] = inst;
+        }
+    }
+
+    // the checksums keep the results of the calls in use
+    double best = 0;
+    uint64_t checksum = 0;
+    for (int r = 0; r < repetitions; r++) {
+        double start = now();
+        for (uint64_t i = 0; i < MICRO_CALLS; i++) {
+            checksum += decode(words[i % num_words]).command_format;
+        }
+        double seconds = now() - start;
+        best = r == 0 || seconds < best ? seconds : best;
+    }
+    report_micro("decode", best, MICRO_CALLS);
+
+    for (int r = 0; r < repetitions && num_insts > 0; r++) {
+        double start = now();
+        for (uint64_t i = 0; i < MICRO_CALLS; i++) {
+            checksum += encode(&insts[i % num_insts]);
+        }
+        double seconds = now() - start;
+        best = r == 0 || seconds < best ? seconds : best;
+    }
+    if (num_insts > 0) {
+        report_micro("encode", best, MICRO_CALLS);
+    }
+
+    free(insts);
+    if (checksum == 0) {
+        printf("(checksum 0)\n");
+    }
+}
+
+/*
+    Times filling a symbol table with labels, and looking every label up.
+*/
+static void bench_symtable(int repetitions) {
+    static char labels[NUM_LABELS][16];
+    for (int i = 0; i < NUM_LABELS; i++) {
+        snprintf(labels[i], sizeof(labels[i]), "label_%d", i);
+    }
+
+    uint64_t rounds = SYMTABLE_ROUNDS;
+    double best_set = 0;
+    double best_get = 0;
+    for (int r = 0; r < repetitions; r++) {
+        double set_seconds = 0;
+        double get_seconds = 0;
+        for (uint64_t round = 0; round < rounds; round++) {
+            SymbolTable table = symtable_new(/* load_factor = */ SYMTABLE_LOAD_FACTOR);
+            if (table == NULL) {
+                fprintf(stderr, "bench: failed to create symbol table\n");
+                exit(1);
+            }
+
+            double start = now();
+            for (int i = 0; i < NUM_LABELS; i++) {
+                single_symtable_set(table, labels[i], i * 4);
+            }
+            double middle = now();
+            uint32_t address;
+            for (int i = 0; i < NUM_LABELS; i++) {
+                if (!symtable_get(table, labels[i], &address) || address != i * 4) {
+                    fprintf(stderr, "bench: symbol table lost %s\n", labels[i]);
+                    exit(1);
+                }
+            }
+            get_seconds += now() - middle;
+            set_seconds += middle - start;
+            symtable_free(table);
+        }
+        best_set = r == 0 || set_seconds < best_set ? set_seconds : best_set;
+        best_get = r == 0 || get_seconds < best_get ? get_seconds : best_get;
+    }
+    report_micro("symtable set", best_set, rounds * NUM_LABELS);
+    report_micro("symtable get", best_get, rounds * NUM_LABELS);
+}
+
+/*
+    Runs the benchmarks over the kernels given on the command line.
+    Returns 0 upon successful termination.
+*/
+int run_bench(int argc, char **argv) {
+    int repetitions = DEFAULT_REPETITIONS;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        if (opt == 'r' && atoi(optarg) > 0) {
+            repetitions = atoi(optarg);
+        } else {
+            fprintf(stderr, "usage: ./bench/bench [-r repetitions] kernel.bin...\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind == argc) {
+        fprintf(stderr, "usage: ./bench/bench [-r repetitions] kernel.bin...\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-24s %-10s %12s %10s %10s %10s\n", "kernel", "mode", "instructions", "ms", "MIPS", "ns/inst");
+    for (int i = optind; i < argc; i++) {
+        bench_kernel(argv[i], repetitions);
+    }
+
+    size_t num_words;
+    uint32_t *words = read_words(argv + optind, argc - optind, &num_words);
+    printf("\n%-24s %12s %10s %10s\n", "microbenchmark", "calls", "ms", "ns/call");
+    if (num_words > 0) {
+        bench_codec(words, num_words, repetitions);
+    }
+    bench_symtable(repetitions);
+    free(words);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    return run_bench(argc, argv);
+}
@@ -0,0 +1,21 @@
+ldr w9, count
+movz x3, #0x1
+movz x1, #0x1b
+branch_loop:
+tst x1, x3
+b.eq even
+add x1, x1, x1, lsl #1
+add x1, x1, #0x1
+b next
+even:
+orr x1, xzr, x1, lsr #1
+next:
+cmp x1, x3
+b.ne counted
+movz x1, #0x1b
+counted:
+subs w9, w9, #0x1
+b.ne branch_loop
+and x0, x0, x0
+count:
+    .int 0x80000
@@ -0,0 +1,112 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "../headers/decode.h"
+#include "../headers/encode.h"
+#include "../headers/fuzz.h"
+#include "../headers/pool.h"
+
+// The 32-bit space is split into tasks of this many consecutive words.
+#define WORDS_PER_TASK (1ULL << 20)
+#define NUM_WORDS (1ULL << 32)
+#define NUM_TASKS (NUM_WORDS / WORDS_PER_TASK)
+#define NUM_FORMATS (BRANCH + 1)
+
+static const char *const format_names[NUM_FORMATS] = {
+    [DP_IMM] = "dp (immediate)", [DP_REG] = "dp (register)",
+    [SINGLE_DATA_TRANSFER] = "single data transfer", [LOAD_LITERAL] = "load literal",
+    [BRANCH] = "branch", [HALT] = "halt", [UNKNOWN] = "unknown"
+};
+
+/*
+    The results of one worker, padded to a cache line of its own so that
+    workers do not share lines while counting.
+*/
+typedef struct {
+    uint64_t format_counts[NUM_FORMATS];
+    uint64_t num_mismatches;
+    uint32_t first_mismatch;
+    char padding[64];
+} FuzzResult;
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/*
+    Checks that every word of a task that decodes to a known instruction
+    encodes back to the same word, counting the words of each format.
+*/
+static void fuzz_task(void *context, size_t task, int worker) {
+    FuzzResult *result = &((FuzzResult *) context)[worker];
+    uint64_t start = task * WORDS_PER_TASK;
+    for (uint64_t word = start; word < start + WORDS_PER_TASK; word++) {
+        Instruction inst = decode(word);
+        result->format_counts[inst.command_format]++;
+        if (inst.command_format != UNKNOWN && encode(&inst) != word) {
+            if (result->num_mismatches++ == 0 || word < result->first_mismatch) {
+                result->first_mismatch = word;
+            }
+        }
+    }
+}
+
+/*
+    Runs encode(decode(w)) == w over every 32-bit word w on all host cores,
+    reporting the words of each format and the round trip throughput.
+    Returns 0 if every known instruction round trips.
+*/
+int run_fuzz(int argc, char **argv) {
+    int num_workers = host_cores();
+    int opt;
+    while ((opt = getopt(argc, argv, "j:")) != -1) {
+        if (opt == 'j' && atoi(optarg) > 0) {
+            num_workers = atoi(optarg);
+        } else {
+            fprintf(stderr, "usage: ./bench/fuzz [-j workers]\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    FuzzResult *results = calloc(num_workers, sizeof(FuzzResult));
+    if (results == NULL) {
+        fprintf(stderr, "fuzz: ran out of memory\n");
+        return EXIT_FAILURE;
+    }
+    double start = now();
+    run_pool(NUM_TASKS, num_workers, fuzz_task, results);
+    double seconds = now() - start;
+
+    FuzzResult total = { .first_mismatch = UINT32_MAX };
+    for (int i = 0; i < num_workers; i++) {
+        for (int format = 0; format < NUM_FORMATS; format++) {
+            total.format_counts[format] += results[i].format_counts[format];
+        }
+        if (results[i].num_mismatches > 0 && results[i].first_mismatch <= total.first_mismatch) {
+            total.first_mismatch = results[i].first_mismatch;
+        }
+        total.num_mismatches += results[i].num_mismatches;
+    }
+    free(results);
+
+    printf("%-24s %12s\n", "format", "words");
+    for (int format = 0; format < NUM_FORMATS; format++) {
+        printf("%-24s %12" PRIu64 "\n", format_names[format], total.format_counts[format]);
+    }
+    printf("\n%d workers, %.3f s, %.2f ns/word\n", num_workers, seconds, seconds * 1e9 / NUM_WORDS);
+    if (total.num_mismatches > 0) {
+        fprintf(stderr, "fuzz: %" PRIu64 " words do not round trip, the first is 0x%08" PRIx32 "\n",
+                total.num_mismatches, total.first_mismatch);
+        return EXIT_FAILURE;
+    }
+    printf("every known instruction round trips\n");
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    return run_fuzz(argc, argv);
+}
@@ -0,0 +1,17 @@
+ldr w9, count
+movz x1, #0x3
+movz x2, #0x5
+movz x3, #0x7
+mul_loop:
+madd x3, x1, x2, x3
+msub x4, x3, x1, x2
+mul x5, x4, x2
+mneg x6, x5, x1
+madd x1, x6, x2, x1
+add x1, x1, #0x3
+mul w7, w1, w3
+subs w9, w9, #0x1
+b.ne mul_loop
+and x0, x0, x0
+count:
+    .int 0x80000
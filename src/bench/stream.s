@@ -0,0 +1,20 @@
+ldr w9, passes
+movz x5, #0x1
+stream_pass:
+movz x1, #0x1000
+movz x2, #0x3000
+movz w3, #0x200
+stream_loop:
+ldr x4, [x1, #8]!
+add x4, x4, x5
+str x4, [x2]
+ldr x6, [x2], #8
+str x6, [x1]
+subs w3, w3, #0x1
+b.ne stream_loop
+add x5, x5, #0x1
+subs w9, w9, #0x1
+b.ne stream_pass
+and x0, x0, x0
+passes:
+    .int 0x400
@@ -0,0 +1,187 @@
+#include "../headers/decode.h"
+#include "../headers/instruction_constants.h"
+#include "../headers/instructions.h"
+
+/* The decoder looks up op0 in a table to find the group of an instruction
+ * in a single indexed load, then calls a field extractor specialised for
+ * that group. Each extractor tells apart the few formats of its group and
+ * reads their fields straight out of the instruction. */
+
+// Decodes the instructions of a group, returning them as a copy.
+typedef Instruction (*GroupDecoder)(uint32_t inst_data);
+
+// Decodes an instruction of a group that holds no known instructions.
+static Instruction decode_unknown(uint32_t inst_data) {
+    return UNKNOWN_INSTRUCTION;
+}
+
+// Decodes a DP (immediate) instruction, of group 100X.
+static Instruction decode_dp_imm(uint32_t inst_data) {
+    Instruction inst = {
+        .command_format = DP_IMM,
+        .sf  = GET_FLAG(inst_data, DP_SF),
+        .opc = GET_FIELD(inst_data, DP_OPC),
+        .rd  = GET_FIELD(inst_data, RD_RT)
+    };
+    switch (GET_FIELD(inst_data, DP_IMM_OPI)) {
+        case ARITH_OPI:
+            inst.dp_imm.operand_type = ARITH_OPERAND;
+            inst.dp_imm.operand.arith_operand.sh    = GET_FLAG(inst_data, ARITH_OP_SH);
+            inst.dp_imm.operand.arith_operand.imm12 = GET_FIELD(inst_data, ARITH_OP_IMM12);
+            inst.dp_imm.operand.arith_operand.rn    = GET_FIELD(inst_data, ARITH_OP_RN);
+            return inst;
+        case WIDE_MOVE_OPI:
+            inst.dp_imm.operand_type = WIDE_MOVE_OPERAND;
+            inst.dp_imm.operand.wide_move_operand.hw    = GET_FIELD(inst_data, WIDE_MOVE_HW);
+            inst.dp_imm.operand.wide_move_operand.imm16 = GET_FIELD(inst_data, WIDE_MOVE_IMM16);
+            return inst;
+        default:
+            return UNKNOWN_INSTRUCTION;
+    }
+}
+
+// Decodes a DP (register) instruction or HALT, of group X101.
+static Instruction decode_dp_reg(uint32_t inst_data) {
+    if (inst_data == HALT_BIN) return HALT_INSTRUCTION;
+    unsigned char opr = GET_FIELD(inst_data, DP_REG_OPR);
+    unsigned char m = GET_FLAG(inst_data, DP_REG_M);
+    /* instructions of the form (M,opr) = (0,1xx0),(0,0xxx),(1,1000) are all recognised,
+     * leaving (1,0xxx) and (0,1xx1) as unrecognised. */
+    if ((m && !GET_BIT(opr, 3)) || (!m && GET_BIT(opr, 0) && GET_BIT(opr, 3))) {
+        return UNKNOWN_INSTRUCTION;
+    }
+    return (Instruction) {
+        .command_format = DP_REG,
+        .sf  = GET_FLAG(inst_data, DP_SF),
+        .opc = GET_FIELD(inst_data, DP_OPC),
+        .rd  = GET_FIELD(inst_data, RD_RT),
+        .dp_reg = {
+            .m = m,
+            .opr = opr,
+            .rm      = GET_FIELD(inst_data, DP_REG_RM),
+            .operand = GET_FIELD(inst_data, DP_REG_OPERAND),
+            .rn      = GET_FIELD(inst_data, DP_REG_RN)
+        }
+    };
+}
+
+// Decodes a single data transfer instruction, given that it is one.
+static Instruction decode_single_data_transfer(uint32_t inst_data) {
+    Instruction inst = {
+        .command_format = SINGLE_DATA_TRANSFER,
+        .sf = GET_FLAG(inst_data, SDT_SF),
+        .rt = GET_FIELD(inst_data, RD_RT),
+        .single_data_transfer = {
+            .u  = GET_FLAG(inst_data, SDT_U),
+            .l  = GET_FLAG(inst_data, SDT_L),
+            .xn = GET_FIELD(inst_data, SDT_XN)
+        }
+    };
+    // offset uses bits 10-21
+    // when U=1, offset is used for imm12 (unsigned)
+    if (inst.single_data_transfer.u) {
+        inst.single_data_transfer.offset_type = UNSIGNED_OFFSET;
+        inst.single_data_transfer.offset.imm12 = GET_FIELD(inst_data, SDT_UNSIGNED_IMM12);
+    } else if (GET_FLAG(inst_data, SDT_REGISTER_MASK_UPPER)
+             && (GET_FIELD(inst_data, SDT_REGISTER_MASK_LOWER)
+                 == SDT_REGISTER_MASK_LOWER)) {
+        inst.single_data_transfer.offset_type = REGISTER_OFFSET;
+        inst.single_data_transfer.offset.xm = GET_FIELD(inst_data, SDT_REGISTER_XM);
+    } else if (!GET_FLAG(inst_data, SDT_INDEX_MASK_UPPER)
+               && GET_FLAG(inst_data, SDT_INDEX_MASK_LOWER)) {
+        // if I = 1, pre-indexed, otherwise post-indexed
+        inst.single_data_transfer.offset_type = GET_FLAG(inst_data, SDT_INDEX_I) ? PRE_INDEX_OFFSET : POST_INDEX_OFFSET;
+        uint16_t simm9_masked = GET_FIELD(inst_data, SDT_INDEX_SIMM9);
+        inst.single_data_transfer.offset.simm9 = SIGN_EXTEND(simm9_masked, 9, 16);
+    } else return UNKNOWN_INSTRUCTION;
+    return inst;
+}
+
+// Decodes a single data transfer or load literal instruction, of group 1100.
+static Instruction decode_loads_and_stores(uint32_t inst_data) {
+    // bits 23-29 11100X0 and bit 31 1
+    if ((GET_FIELD(inst_data, SDT_MASK_MIDDLE)
+         == SDT_MASK_MIDDLE)
+        && !GET_FLAG(inst_data, SDT_MASK_LOWER)
+        && GET_FLAG(inst_data, SDT_MASK_UPPER)) return decode_single_data_transfer(inst_data);
+    // bits 24-29 011000 and bit 31 0
+    if ((GET_FIELD(inst_data, LOAD_LITERAL_MASK)
+         == LOAD_LITERAL_MASK >> LOAD_LITERAL_MASK_START)
+        && !GET_FLAG(inst_data, LOAD_LITERAL_UPPER_MASK)) {
+        // sign extend simm19
+        uint32_t simm19_masked = GET_FIELD(inst_data, LOAD_LITERAL_SIMM19);
+        return (Instruction) {
+            .command_format = LOAD_LITERAL,
+            .sf = GET_FLAG(inst_data, SDT_SF),
+            .rt = GET_FIELD(inst_data, RD_RT),
+            .load_literal = { .simm19 = SIGN_EXTEND(simm19_masked, 19, 32) }
+        };
+    }
+    return UNKNOWN_INSTRUCTION;
+}
+
+// Decodes a branch instruction, of group 101X.
+// Each format's mask includes the bits common to all branches.
+static Instruction decode_branch(uint32_t inst_data) {
+    if (GET_FIELD(inst_data, BRANCH_UNCOND_MASK)
+        == BRANCH_UNCOND_MASK >> BRANCH_UNCOND_MASK_START) {
+        uint32_t simm26_masked = GET_FIELD(inst_data, BRANCH_UNCOND_SIMM26);
+        return (Instruction) {
+            .command_format = BRANCH,
+            .branch = { .operand_type = UNCOND_BRANCH, .operand = { .uncond_branch =
+                { .simm26 = SIGN_EXTEND(simm26_masked, 26, 32) }
+            } }
+        };
+    }
+    if ((GET_FIELD(inst_data, BRANCH_COND_UPPER_MASK)
+         == BRANCH_COND_MASK >> BRANCH_COND_UPPER_MASK_START)
+        && !GET_FLAG(inst_data, BRANCH_COND_LOWER_MASK)) {
+        uint32_t simm19_masked = GET_FIELD(inst_data, BRANCH_COND_SIMM19);
+        return (Instruction) {
+            .command_format = BRANCH,
+            .branch = { .operand_type = COND_BRANCH, .operand = { .cond_branch =
+                {
+                    .cond = GET_FIELD(inst_data, BRANCH_COND_COND),
+                    .simm19 = SIGN_EXTEND(simm19_masked, 19, 32)
+                }
+            } }
+        };
+    }
+    if (GET_FIELD(inst_data, BRANCH_REG_MASK_LOWER) == 0
+        && (GET_FIELD(inst_data, BRANCH_REG_MASK_UPPER)
+            == BRANCH_REG_MASK >> BRANCH_REG_MASK_UPPER_START)) {
+        return (Instruction) {
+            .command_format = BRANCH,
+            .branch = { .operand_type = REGISTER_BRANCH, .operand = { .register_branch =
+                { .xn = GET_FIELD(inst_data, BRANCH_REG_XN) }
+            } }
+        };
+    }
+    return UNKNOWN_INSTRUCTION;
+}
+
+// The decoder of each group, indexed by op0.
+static const GroupDecoder group_decoders[NUM_OP0] = {
+    decode_unknown,          // 0000
+    decode_unknown,          // 0001
+    decode_unknown,          // 0010
+    decode_unknown,          // 0011
+    decode_unknown,          // 0100
+    decode_dp_reg,           // 0101
+    decode_unknown,          // 0110
+    decode_unknown,          // 0111
+    decode_dp_imm,           // 1000
+    decode_dp_imm,           // 1001
+    decode_branch,           // 1010
+    decode_branch,           // 1011
+    decode_loads_and_stores, // 1100
+    decode_dp_reg,           // 1101
+    decode_unknown,          // 1110
+    decode_unknown           // 1111
+};
+
+/* Decodes an instruction from ARMv8-a.
+ * If the instruction is malformed or unknown, the Instruction's command_format field will be UNKNOWN. */
+Instruction decode(uint32_t inst_data) {
+    return group_decoders[GET_FIELD(inst_data, OP0)](inst_data);
+}
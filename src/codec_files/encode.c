@@ -15,12 +15,12 @@ static uint32_t encode_dp_imm_operand(const Instruction *inst) {
     DPImmOperand operand = inst->dp_imm.operand;
     switch (operand_type) {
         case ARITH_OPERAND:
-            return ((uint32_t) operand.arith_operand.sh    << ARITH_OP_SH_BIT)
-                   | ((uint32_t) operand.arith_operand.imm12 << ARITH_OP_IMM12_START)
-                   | ((uint32_t) operand.arith_operand.rn    << ARITH_OP_RN_START);
+            return PUT_FLAG(operand.arith_operand.sh, ARITH_OP_SH)
+                   | PUT_FIELD(operand.arith_operand.imm12, ARITH_OP_IMM12)
+                   | PUT_FIELD(operand.arith_operand.rn, ARITH_OP_RN);
         case WIDE_MOVE_OPERAND:
-            return ((uint32_t) operand.wide_move_operand.hw    << WIDE_MOVE_HW_START)
-                   | ((uint32_t) operand.wide_move_operand.imm16 << WIDE_MOVE_IMM16_START);
+            return PUT_FIELD(operand.wide_move_operand.hw, WIDE_MOVE_HW)
+                   | PUT_FIELD(operand.wide_move_operand.imm16, WIDE_MOVE_IMM16);
         default: FAIL_ENCODE();
     }
 }
@@ -34,15 +34,15 @@ static uint32_t encode_sdt_offset(const Instruction *inst) {
         case PRE_INDEX_OFFSET:
             i = 1;
         case POST_INDEX_OFFSET:
+            // the field cuts off the sign extension of negative values
             return SDT_INDEX_MASK
-                   | ((uint32_t) i << SDT_INDEX_I_BIT)
-                   // since the value is signed, we need to apply a mask to remove negated bits
-                   | (uint32_t) BITMASK(offset.simm9, 0, 8) << SDT_INDEX_SIMM9_START;
+                   | PUT_FLAG(i, SDT_INDEX_I)
+                   | PUT_FIELD(offset.simm9, SDT_INDEX_SIMM9);
         case REGISTER_OFFSET:
             return SDT_REGISTER_MASK
-                   | ((uint32_t) offset.xm << SDT_REGISTER_XM_START);
+                   | PUT_FIELD(offset.xm, SDT_REGISTER_XM);
         case UNSIGNED_OFFSET:
-            return (uint32_t) offset.imm12 << SDT_UNSIGNED_IMM12_START;
+            return PUT_FIELD(offset.imm12, SDT_UNSIGNED_IMM12);
         default: FAIL_ENCODE();
     }
 }
@@ -59,70 +59,62 @@ static uint32_t encode_dp_imm(const Instruction *inst) {
         default: FAIL_ENCODE(); // if the operand type is unknown
     }
     return DP_IMM_MASK
-           | ((uint32_t) inst->sf  << DP_SF_BIT)
-           | ((uint32_t) inst->opc << DP_OPC_START)
-           | ((uint32_t) opi       << DP_IMM_OPI_START)
+           | PUT_FLAG(inst->sf, DP_SF)
+           | PUT_FIELD(inst->opc, DP_OPC)
+           | PUT_FIELD(opi, DP_IMM_OPI)
            | encode_dp_imm_operand(inst)
-           | ((uint32_t) inst->rd  << RD_RT_START);
+           | PUT_FIELD(inst->rd, RD_RT);
 }
 
 // Encodes a DP (register) instruction, given a reference to an Instruction.
 static uint32_t encode_dp_reg(const Instruction *inst) {
     return DP_REG_MASK
-           | ((uint32_t) inst->rd             << RD_RT_START)
-           | ((uint32_t) inst->dp_reg.rn      << DP_REG_RN_START)
-           | ((uint32_t) inst->dp_reg.operand << DP_REG_OPERAND_START)
-           | ((uint32_t) inst->dp_reg.rm      << DP_REG_RM_START)
-           | ((uint32_t) inst->dp_reg.opr     << DP_REG_OPR_START)
-           | ((uint32_t) inst->dp_reg.m       << DP_REG_M_BIT)
-           | ((uint32_t) inst->opc            << DP_OPC_START)
-           | ((uint32_t) inst->sf             << DP_SF_BIT);
+           | PUT_FIELD(inst->rd,             RD_RT)
+           | PUT_FIELD(inst->dp_reg.rn,      DP_REG_RN)
+           | PUT_FIELD(inst->dp_reg.operand, DP_REG_OPERAND)
+           | PUT_FIELD(inst->dp_reg.rm,      DP_REG_RM)
+           | PUT_FIELD(inst->dp_reg.opr,     DP_REG_OPR)
+           | PUT_FLAG(inst->dp_reg.m,        DP_REG_M)
+           | PUT_FIELD(inst->opc,            DP_OPC)
+           | PUT_FLAG(inst->sf,              DP_SF);
 }
 
 // Encodes a single data transfer instruction, given a reference to an Instruction.
 static uint32_t encode_single_data_transfer(const Instruction *inst) {
     return FILL_BIT(SDT_MASK_UPPER_BIT)
-           | ((uint32_t) SDT_MASK_MIDDLE << SDT_MASK_MIDDLE_START)
+           | PUT_FIELD(SDT_MASK_MIDDLE, SDT_MASK_MIDDLE)
            // no need to add the mask lower bit as it is zero
-           | ((uint32_t) inst->rt << RD_RT_START)
-           | ((uint32_t) inst->single_data_transfer.xn << SDT_XN_START)
+           | PUT_FIELD(inst->rt, RD_RT)
+           | PUT_FIELD(inst->single_data_transfer.xn, SDT_XN)
            | encode_sdt_offset(inst)
-           | ((uint32_t) inst->single_data_transfer.l << SDT_L_BIT)
-           | ((uint32_t) inst->single_data_transfer.u << SDT_U_BIT)
-           | ((uint32_t) inst->sf << SDT_SF_BIT);
+           | PUT_FLAG(inst->single_data_transfer.l, SDT_L)
+           | PUT_FLAG(inst->single_data_transfer.u, SDT_U)
+           | PUT_FLAG(inst->sf, SDT_SF);
 }
 
 // Encodes a load literal instruction, given a reference to an Instruction.
 static uint32_t encode_load_literal(const Instruction *inst) {
-    // mask simm19 to remove leading 1 bits for negative values
-    uint32_t simm19_masked = BITMASK(inst->load_literal.simm19, 0, 18);
+    // the field cuts off the sign extension of negative values
     return LOAD_LITERAL_MASK
-           | ((uint32_t) inst->rt << RD_RT_START)
-           | (simm19_masked << LOAD_LITERAL_SIMM19_START)
-           | ((uint32_t) inst->sf << SDT_SF_BIT);
+           | PUT_FIELD(inst->rt, RD_RT)
+           | PUT_FIELD(inst->load_literal.simm19, LOAD_LITERAL_SIMM19)
+           | PUT_FLAG(inst->sf, SDT_SF);
 }
 
 // Encodes a branch instruction, given a reference to an Instruction.
 static uint32_t encode_branch(const Instruction *inst) {
+    // the fields cut off the sign extension of negative offsets
     switch (inst->branch.operand_type) {
-        case UNCOND_BRANCH: {
-            // need to remove leading 1 bits in case simm26 is negative
-            uint32_t simm26_masked = BITMASK(inst->branch.operand.uncond_branch.simm26, 0, 25);
+        case UNCOND_BRANCH:
             return BRANCH_UNCOND_MASK
-                   | (simm26_masked << BRANCH_UNCOND_SIMM26_START);
-        }
-        case COND_BRANCH: {
-            uint32_t cond = inst->branch.operand.cond_branch.cond;
-            uint32_t simm19_masked = BITMASK(inst->branch.operand.cond_branch.simm19, 0, 18);
+                   | PUT_FIELD(inst->branch.operand.uncond_branch.simm26, BRANCH_UNCOND_SIMM26);
+        case COND_BRANCH:
             return BRANCH_COND_MASK
-                   | (simm19_masked << BRANCH_COND_SIMM19_START)
-                   | (cond << BRANCH_COND_COND_START);
-        }
-        case REGISTER_BRANCH: {
-            uint32_t xn = inst->branch.operand.register_branch.xn;
+                   | PUT_FIELD(inst->branch.operand.cond_branch.simm19, BRANCH_COND_SIMM19)
+                   | PUT_FIELD(inst->branch.operand.cond_branch.cond, BRANCH_COND_COND);
+        case REGISTER_BRANCH:
             return BRANCH_REG_MASK
-                   | (xn << BRANCH_REG_XN_START);
-        }
+                   | PUT_FIELD(inst->branch.operand.register_branch.xn, BRANCH_REG_XN);
         default: FAIL_ENCODE();
     }
 }
@@ -1,28 +1,343 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "headers/emulate.h"
-#include "headers/execute.h"
-#include "headers/decode.h"
-#include "headers/fetch.h"
-#include "headers/fileio.h"
+#include "headers/emulator.h"
 #include "headers/memory.h"
-#include "headers/registers.h"
+#include "headers/pool.h"
+#include "headers/profile.h"
+#include "headers/snapshot.h"
+#include "headers/timing.h"
+#include "headers/trace.h"
 
-// Pointer to output file name if it is given.
-static char *output_file = NULL;
+// The machine to create; the last mode given on the command line wins.
+static EmulatorConfig config = { .memory_size = MEMORY_SIZE, .execution_mode = INTERPRET, .num_cores = 1 };
 
-/* 
-    Function to return the output file name pointer.
+// Manifest of programs to run when in batch mode.
+static char *batch_manifest = NULL;
+
+// Number of threads running the programs of a batch, or 0 for one per core.
+static int batch_jobs = 1;
+
+// Where to save a snapshot, and after how many steps of the machine.
+static char *snapshot_file = NULL;
+static uint64_t snapshot_at = 0;
+static bool snapshot_at_given = false;
+
+// Snapshot to resume from instead of loading an input file.
+static char *restore_file = NULL;
+
+// File to record a trace of every instruction run into.
+static char *trace_file = NULL;
+
+// Whether to count every instruction run, where to report the counts (or
+// stderr if NULL), and the assembler's symbols to name code by.
+static bool profiling = false;
+static char *profile_file = NULL;
+static char *symbol_file = NULL;
+
+// Latencies to charge the instructions run, reported on stderr, if timing.
+static bool timing = false;
+static TimingModel timing_model;
+
+static const struct option long_options[] = {
+    { "blocks",        no_argument,       NULL, 'b' },
+    { "jit",           no_argument,       NULL, 'j' },
+    { "memory-size",   required_argument, NULL, 'm' },
+    { "batch",         required_argument, NULL, 'B' },
+    { "jobs",          required_argument, NULL, 'J' },
+    { "cores",         required_argument, NULL, 'c' },
+    { "round-robin",   no_argument,       NULL, 'r' },
+    { "snapshot-at",   required_argument, NULL, 's' },
+    { "snapshot-file", required_argument, NULL, 'S' },
+    { "restore",       required_argument, NULL, 'R' },
+    { "trace",         required_argument, NULL, 't' },
+    { "profile",       optional_argument, NULL, 'p' },
+    { "symbols",       required_argument, NULL, 'y' },
+    { "timing",        optional_argument, NULL, 'T' },
+    { NULL,            0,                 NULL, 0   }
+};
+
+/*
+    Prints the usage message and exits with failure.
+*/
+static void usage(void) {
+    fprintf(stderr, "usage: ./emulate [options] [--snapshot-at=steps --snapshot-file=file] [input_file] [optional_output_file]\n"
+                    "       ./emulate [options] --restore=file [optional_output_file]\n"
+                    "       ./emulate [options] [--jobs=threads] --batch=manifest\n"
+                    "options: [--blocks | --jit] [--memory-size=bytes[K|M|G]] [--cores=n [--round-robin]] [--trace=file]\n"
+                    "         [--profile[=report_file] [--symbols=symbol_file]] [--timing[=class=cycles,...]]\n");
+    exit(1);
+}
+
+/*
+    Takes a size in bytes, optionally suffixed with K, M or G.
+    Returns the size, which is rounded up to a whole number of pages.
 */
-char *get_output_file(void) { return output_file; }
+static uint64_t parse_memory_size(const char *arg) {
+    char *end;
+    errno = 0;
+    unsigned long long size = strtoull(arg, &end, 0);
+    int shift = 0;
+    switch (*end) {
+        case 'K': case 'k': shift = 10; end++; break;
+        case 'M': case 'm': shift = 20; end++; break;
+        case 'G': case 'g': shift = 30; end++; break;
+    }
+    if (errno != 0 || end == arg || *end != '\0' || size == 0 || size > (MAX_MEMORY_SIZE >> shift)) {
+        fprintf(stderr, "emulate: memory size must be between 1 byte and 4G, not %s\n", arg);
+        exit(1);
+    }
+    size <<= shift;
+    return (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
 
 /*
-    Function to initialise the machine
+    Takes the argument of --snapshot-at. Returns the number of steps.
 */
-static void initialise(void) {
-    initmem();
-    init_machine_state();
+static uint64_t parse_steps(const char *arg) {
+    char *end;
+    errno = 0;
+    unsigned long long steps = strtoull(arg, &end, 0);
+    if (errno != 0 || end == arg || *end != '\0' || arg[0] == '-') {
+        fprintf(stderr, "emulate: the number of steps must be a non-negative integer, not %s\n", arg);
+        exit(1);
+    }
+    return steps;
+}
+
+/*
+    Steps the machine snapshot_at times, in which each core that has not
+    halted runs one instruction, and saves a snapshot of it.
+*/
+static void take_snapshot(Emulator *emulator) {
+    uint64_t steps = 0;
+    while (steps < snapshot_at && !emulator_halted(emulator)) {
+        emulator_step(emulator);
+        steps++;
+    }
+    if (steps < snapshot_at) {
+        fprintf(stderr, "emulate: halted after %" PRIu64 " steps, so no snapshot was taken\n", steps);
+        return;
+    }
+    write_snapshot(emulator, snapshot_file);
+}
+
+/*
+    Runs the emulator until it halts, printing the output and then any
+    reports asked for.
+*/
+static void finish_run(Emulator *emulator) {
+    emulator_run(emulator);
+    if (timing) {
+        timing_report(&timing_model, emulator, stderr);
+    }
+}
+
+/*
+    Resets the emulator, loads input_file and runs it until it halts,
+    writing the output to output_filename (or stdout if it is NULL).
+    A snapshot is saved on the way if one was asked for.
+*/
+static void run_program(Emulator *emulator, char *input_file, char *output_filename) {
+    emulator_load(emulator, input_file);
+    emulator_set_output(emulator, output_filename);
+    emulator_set_timing(emulator, timing ? &timing_model : NULL);
+    if (snapshot_file != NULL) {
+        take_snapshot(emulator);
+    }
+    finish_run(emulator);
+}
+
+// A program of a batch, and the file its output is written to.
+typedef struct {
+    char *input_file;
+    char *output_file;
+} BatchProgram;
+
+typedef struct {
+    BatchProgram *programs;
+    // one emulator per worker, reused for every program the worker runs
+    Emulator **emulators;
+} Batch;
+
+/*
+    Takes a manifest file. Each non-empty line holds an input file and an
+    output file separated by whitespace; lines starting with '#' are ignored.
+    Returns the programs listed, setting num_programs to their number.
+*/
+static BatchProgram *read_manifest(char *manifest, size_t *num_programs) {
+    FILE *manifest_file = fopen(manifest, "r");
+    if (manifest_file == NULL) {
+        fprintf(stderr, "run_batch: can't open %s, errno %d\n", manifest, errno);
+        exit(1);
+    }
+
+    BatchProgram *programs = NULL;
+    size_t capacity = 0;
+    *num_programs = 0;
+
+    char *line = NULL;
+    size_t line_size = 0;
+    for (int line_number = 1; getline(&line, &line_size, manifest_file) != -1; line_number++) {
+        char *input_file = strtok(line, " \t\r\n");
+        if (input_file == NULL || input_file[0] == '#') continue;
+        char *output_filename = strtok(NULL, " \t\r\n");
+        if (output_filename == NULL || strtok(NULL, " \t\r\n") != NULL) {
+            fprintf(stderr, "run_batch: %s:%d: expected an input file and an output file\n", manifest, line_number);
+            exit(1);
+        }
+
+        if (*num_programs == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            programs = realloc(programs, capacity * sizeof(BatchProgram));
+        }
+        if (programs == NULL) {
+            fprintf(stderr, "run_batch: ran out of memory\n");
+            exit(1);
+        }
+        programs[*num_programs] = (BatchProgram) { strdup(input_file), strdup(output_filename) };
+        if (programs[*num_programs].input_file == NULL || programs[*num_programs].output_file == NULL) {
+            fprintf(stderr, "run_batch: ran out of memory\n");
+            exit(1);
+        }
+        (*num_programs)++;
+    }
+
+    free(line);
+    fclose(manifest_file);
+    return programs;
+}
+
+static void run_batch_program(void *context, size_t program, int worker) {
+    Batch *batch = context;
+    run_program(batch->emulators[worker], batch->programs[program].input_file,
+                batch->programs[program].output_file);
+}
+
+/*
+    Runs every program listed in the manifest file across jobs threads,
+    or one thread per host core if jobs is 0. Each thread has an emulator
+    of its own, so programs never share machine state or memory.
+*/
+static void run_batch(char *manifest, int jobs) {
+    size_t num_programs;
+    Batch batch;
+    batch.programs = read_manifest(manifest, &num_programs);
+
+    if (jobs == 0) {
+        jobs = host_cores();
+    }
+    if ((size_t) jobs > num_programs) {
+        jobs = num_programs > 0 ? num_programs : 1;
+    }
+    batch.emulators = malloc(jobs * sizeof(Emulator *));
+    if (batch.emulators == NULL) {
+        fprintf(stderr, "run_batch: ran out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < jobs; i++) {
+        batch.emulators[i] = emulator_create(&config);
+    }
+
+    run_pool(num_programs, jobs, run_batch_program, &batch);
+
+    for (int i = 0; i < jobs; i++) {
+        emulator_destroy(batch.emulators[i]);
+    }
+    free(batch.emulators);
+    for (size_t i = 0; i < num_programs; i++) {
+        free(batch.programs[i].input_file);
+        free(batch.programs[i].output_file);
+    }
+    free(batch.programs);
+}
+
+/*
+    Takes the argument of --jobs. Returns the number of threads, which is
+    0 for one per host core.
+*/
+static int parse_jobs(const char *arg) {
+    char *end;
+    errno = 0;
+    long jobs = strtol(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || jobs < 0 || jobs > 1024) {
+        fprintf(stderr, "emulate: jobs must be between 0 (one per core) and 1024, not %s\n", arg);
+        exit(1);
+    }
+    return jobs;
+}
+
+/*
+    Takes the argument of --cores. Returns the number of cores.
+*/
+static int parse_cores(const char *arg) {
+    char *end;
+    errno = 0;
+    long cores = strtol(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || cores < 1 || cores > MAX_CORES) {
+        fprintf(stderr, "emulate: cores must be between 1 and %d, not %s\n", MAX_CORES, arg);
+        exit(1);
+    }
+    return cores;
+}
+
+/*
+    Starts recording a trace of the emulator if one was asked for.
+    Returns the trace, or NULL if there is none.
+*/
+static Trace *open_trace(Emulator *emulator) {
+    Trace *trace = trace_file != NULL ? trace_open(trace_file) : NULL;
+    emulator_set_trace(emulator, trace);
+    return trace;
+}
+
+static void close_trace(Trace *trace) {
+    if (trace != NULL) {
+        trace_close(trace);
+    }
+}
+
+/*
+    Starts counting the instructions the emulator runs if a profile was
+    asked for. Returns the profile, or NULL if there is none.
+*/
+static Profile *open_profile(Emulator *emulator) {
+    Profile *profile = NULL;
+    if (profiling) {
+        profile = profile_new(emulator->num_cores);
+        if (symbol_file != NULL && !profile_load_symbols(profile, symbol_file)) {
+            exit(1);
+        }
+    }
+    emulator_set_profile(emulator, profile);
+    return profile;
+}
+
+/*
+    Writes the report of the profile, if there is one, and frees it.
+*/
+static void close_profile(Profile *profile) {
+    if (profile == NULL) {
+        return;
+    }
+    FILE *file = stderr;
+    if (profile_file != NULL) {
+        file = fopen(profile_file, "w");
+        if (file == NULL) {
+            fprintf(stderr, "emulate: can't open %s, errno %d\n", profile_file, errno);
+            exit(1);
+        }
+    }
+    profile_report(profile, file);
+    if (profile_file != NULL) {
+        fclose(file);
+    }
+    profile_free(profile);
 }
 
 /*
@@ -30,30 +345,78 @@ static void initialise(void) {
     Returns 0 upon successful termination.
 */
 int run_emulator(int argc, char **argv) {
-    // Check number of arguments.
-    if (argc > 3 || argc == 1) {
-        fprintf(stderr, "usage: ./emulate [input_file] [optional_output_file]");
-        exit(1);
+    // Parse options, leaving the file names in argv[optind] onwards.
+    int opt;
+    timing_default(&timing_model);
+    while ((opt = getopt_long(argc, argv, "bjm:J:c:rs:S:R:t:p::y:T::", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'b': config.execution_mode = BLOCKS; break;
+            case 'j': config.execution_mode = JIT; break;
+            case 'm': config.memory_size = parse_memory_size(optarg); break;
+            case 'B': batch_manifest = optarg; break;
+            case 'J': batch_jobs = parse_jobs(optarg); break;
+            case 'c': config.num_cores = parse_cores(optarg); break;
+            case 'r': config.round_robin = true; break;
+            case 's': snapshot_at = parse_steps(optarg); snapshot_at_given = true; break;
+            case 'S': snapshot_file = optarg; break;
+            case 'R': restore_file = optarg; break;
+            case 't': trace_file = optarg; break;
+            case 'p': profiling = true; profile_file = optarg; break;
+            case 'y': symbol_file = optarg; break;
+            case 'T':
+                timing = true;
+                if (optarg != NULL && !timing_parse(&timing_model, optarg)) {
+                    exit(1);
+                }
+                break;
+            default:  usage();
+        }
     }
 
-    // If output file is given, store it in output_file.
-    if (argc == 3) {
-        output_file = argv[2];
+    // Snapshots, traces, profiles and timings are taken and restored for single programs only.
+    if (snapshot_at_given != (snapshot_file != NULL)
+        || (restore_file != NULL && snapshot_file != NULL)
+        || (symbol_file != NULL && !profiling)
+        || (batch_manifest != NULL && (snapshot_file != NULL || restore_file != NULL || trace_file != NULL || profiling || timing))) {
+        usage();
     }
 
-    // Initialise machine state and memory, and load the input file.
-    initialise();
-    store_file_to_mem(argv[1]);
-
-    // Run the machine, waiting for the halt instruction to exit.
-    while (1) {
-        MachineState machine_state = read_machine_state();
-        uint32_t inst_data = fetch(&machine_state);
-        Instruction inst = decode(inst_data);
-        execute(&inst);
-        increment_pc();
+    // Check number of arguments.
+    int num_files = argc - optind;
+    if (restore_file != NULL) {
+        if (num_files > 1) {
+            usage();
+        }
+        Emulator *emulator = restore_snapshot(restore_file, &config);
+        Trace *trace = open_trace(emulator);
+        Profile *profile = open_profile(emulator);
+        emulator_set_output(emulator, num_files == 1 ? argv[optind] : NULL);
+        emulator_set_timing(emulator, timing ? &timing_model : NULL);
+        finish_run(emulator);
+        close_trace(trace);
+        close_profile(profile);
+        emulator_destroy(emulator);
+        return 0;
+    }
+    if (batch_manifest != NULL) {
+        if (num_files != 0) {
+            usage();
+        }
+        run_batch(batch_manifest, batch_jobs);
+        return 0;
+    }
+    if (num_files > 2 || num_files == 0) {
+        usage();
     }
 
+    // The output file is optional.
+    Emulator *emulator = emulator_create(&config);
+    Trace *trace = open_trace(emulator);
+    Profile *profile = open_profile(emulator);
+    run_program(emulator, argv[optind], num_files == 2 ? argv[optind + 1] : NULL);
+    close_trace(trace);
+    close_profile(profile);
+    emulator_destroy(emulator);
     return 0;
 }
 
@@ -0,0 +1,356 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../headers/block.h"
+#include "../headers/decode.h"
+#include "../headers/emulator.h"
+#include "../headers/execute.h"
+#include "../headers/instruction_constants.h"
+#include "../headers/memory.h"
+
+#define WORD_BYTES 4
+
+/*
+    A translated basic block: the instructions from start up to and
+    including the first branch or halt, as pre-resolved handlers.
+    The final op always returns false.
+*/
+typedef struct {
+    // the block is valid while this matches cache_generation
+    uint32_t generation;
+    uint32_t start;
+    // address just past the last translated instruction
+    uint64_t end;
+    BlockOp ops[MAX_BLOCK_OPS + 1];
+} Block;
+
+struct block_cache {
+    // Bumped to invalidate every block at once; entries never match 0.
+    uint32_t generation;
+    // The block currently being run, and whether a store has overwritten it.
+    const Block *running_block;
+    bool running_block_stale;
+    // Direct-mapped cache of translated blocks, indexed by start address.
+    Block blocks[BLOCK_CACHE_ENTRIES];
+};
+
+/*
+    Clears the block cache. Only the generation is bumped, so this is
+    cheap enough to call before every program of a batch.
+*/
+void block_cache_init(Core *core) {
+    BlockCache *cache = core->block_cache;
+    if (cache == NULL) {
+        return;
+    }
+    if (++cache->generation == 0) {
+        memset(cache->blocks, 0, sizeof(cache->blocks));
+        cache->generation = 1;
+    }
+    cache->running_block = NULL;
+    cache->running_block_stale = false;
+}
+
+/*
+    Frees the block cache, if one was ever allocated.
+*/
+void block_cache_free(Core *core) {
+    free(core->block_cache);
+    core->block_cache = NULL;
+}
+
+/* Handlers for translated instructions.
+ * Operands are extracted at translation time; the program counter
+ * already holds the fall-through address of the block. */
+
+static bool op_arith_imm(Core *core, const BlockOp *op) {
+    MachineState *machine_state = &core->machine_state;
+    uint64_t rn_data = read_general_registers(machine_state, op->rn);
+    op->function.dp(machine_state, op->rd, rn_data, op->imm, op->sf);
+    return true;
+}
+
+static bool op_dp_reg(Core *core, const BlockOp *op) {
+    MachineState *machine_state = &core->machine_state;
+    uint64_t rn_data = read_general_registers(machine_state, op->rn);
+    uint64_t rm_data = read_general_registers(machine_state, op->rm);
+    uint64_t op2 = shift_operand(rm_data, op->selector, op->amount, op->sf);
+    op->function.dp(machine_state, op->rd, rn_data, op2, op->sf);
+    return true;
+}
+
+static bool op_multiply(Core *core, const BlockOp *op) {
+    MachineState *machine_state = &core->machine_state;
+    uint64_t rn_data = read_general_registers(machine_state, op->rn);
+    uint64_t rm_data = read_general_registers(machine_state, op->rm);
+    execute_multiply(machine_state, op->rd, rn_data, rm_data, op->selector, op->amount, op->sf);
+    return true;
+}
+
+static bool op_wide_move(Core *core, const BlockOp *op) {
+    MachineState *machine_state = &core->machine_state;
+    op->function.wide_move(machine_state, op->rd, op->imm, op->amount, op->sf);
+    return true;
+}
+
+static bool op_nop(Core *core, const BlockOp *op) {
+    return true;
+}
+
+/*
+    Performs a transfer, leaving the block after the current instruction
+    if a store has overwritten the block being run.
+*/
+static bool transfer(Core *core, const BlockOp *op, uint64_t address) {
+    execute_transfer(core, op->load, op->rd, address, op->sf);
+    if (core->block_cache->running_block_stale) {
+        write_program_counter(&core->machine_state, op->address + WORD_BYTES);
+        return false;
+    }
+    return true;
+}
+
+static bool op_transfer_register(Core *core, const BlockOp *op) {
+    MachineState *machine_state = &core->machine_state;
+    uint64_t address = read_general_registers(machine_state, op->rn)
+                       + read_general_registers(machine_state, op->rm);
+    return transfer(core, op, address);
+}
+
+static bool op_transfer_unsigned(Core *core, const BlockOp *op) {
+    MachineState *machine_state = &core->machine_state;
+    uint64_t address = read_general_registers(machine_state, op->rn) + op->imm;
+    return transfer(core, op, address);
+}
+
+static bool op_transfer_pre_index(Core *core, const BlockOp *op) {
+    MachineState *machine_state = &core->machine_state;
+    uint64_t address = read_general_registers(machine_state, op->rn) + op->imm;
+    bool in_block = transfer(core, op, address);
+    write_general_registers(machine_state, op->rn, op->sf ? address : (uint32_t) address);
+    return in_block;
+}
+
+static bool op_transfer_post_index(Core *core, const BlockOp *op) {
+    MachineState *machine_state = &core->machine_state;
+    uint64_t rn_data = read_general_registers(machine_state, op->rn);
+    bool in_block = transfer(core, op, rn_data);
+    uint64_t address = rn_data + op->imm;
+    write_general_registers(machine_state, op->rn, op->sf ? address : (uint32_t) address);
+    return in_block;
+}
+
+static bool op_load_literal(Core *core, const BlockOp *op) {
+    execute_transfer(core, true, op->rd, op->imm, op->sf);
+    return true;
+}
+
+static bool op_branch(Core *core, const BlockOp *op) {
+    MachineState *machine_state = &core->machine_state;
+    machine_state->program_counter.data = op->imm;
+    return false;
+}
+
+static bool op_branch_cond(Core *core, const BlockOp *op) {
+    MachineState *machine_state = &core->machine_state;
+    if (condition_holds(machine_state, op->selector)) {
+        machine_state->program_counter.data = op->imm;
+    }
+    return false;
+}
+
+// Runs an instruction through execute(), as the interpreter loop would.
+static bool op_execute(Core *core, const BlockOp *op) {
+    MachineState *machine_state = &core->machine_state;
+    write_program_counter(machine_state, op->address);
+    execute(core, &op->inst);
+    increment_pc(machine_state);
+    return false;
+}
+
+static bool op_end(Core *core, const BlockOp *op) {
+    return false;
+}
+
+/*
+    Translates one decoded instruction at address into op.
+    Returns true if the instruction ends the block.
+*/
+static bool translate_op(BlockOp *op, const Instruction *inst, uint32_t address) {
+    *op = (BlockOp) { .address = address, .sf = inst->sf, .rd = inst->rd, .inst = *inst };
+
+    switch (inst->command_format) {
+        case DP_IMM: {
+            if (inst->dp_imm.operand_type == ARITH_OPERAND) {
+                uint64_t imm12 = inst->dp_imm.operand.arith_operand.imm12;
+                op->handler = op_arith_imm;
+                op->function.dp = arith_functions[inst->opc];
+                op->rn = inst->dp_imm.operand.arith_operand.rn;
+                op->imm = inst->dp_imm.operand.arith_operand.sh ? imm12 << 12 : imm12;
+                return false;
+            }
+            uint64_t imm16 = inst->dp_imm.operand.wide_move_operand.imm16;
+            op->amount = inst->dp_imm.operand.wide_move_operand.hw;
+            op->imm = imm16 << (op->amount * 16);
+            op->function.wide_move = wide_move_functions[inst->opc];
+            op->handler = op->function.wide_move != NULL ? op_wide_move : op_nop;
+            return false;
+        }
+        case DP_REG: {
+            op->rn = inst->dp_reg.rn;
+            op->rm = inst->dp_reg.rm;
+            if (inst->dp_reg.m) {
+                op->handler = op_multiply;
+                op->selector = BITMASK(inst->dp_reg.operand, 0, 4);
+                op->amount = GET_BIT(inst->dp_reg.operand, 5);
+                return false;
+            }
+            op->handler = op_dp_reg;
+            op->function.dp = GET_BIT(inst->dp_reg.opr, 3)
+                              ? arith_functions[inst->opc]
+                              : logical_functions[inst->opc];
+            op->selector = inst->dp_reg.opr;
+            op->amount = inst->dp_reg.operand;
+            return false;
+        }
+        case SINGLE_DATA_TRANSFER: {
+            op->load = inst->single_data_transfer.l;
+            op->rn = inst->single_data_transfer.xn;
+            SDTOffset offset = inst->single_data_transfer.offset;
+            switch (inst->single_data_transfer.offset_type) {
+                case REGISTER_OFFSET:
+                    op->handler = op_transfer_register;
+                    op->rm = offset.xm;
+                    break;
+                case PRE_INDEX_OFFSET:
+                    op->handler = op_transfer_pre_index;
+                    op->imm = (int64_t) offset.simm9;
+                    break;
+                case POST_INDEX_OFFSET:
+                    op->handler = op_transfer_post_index;
+                    op->imm = (int64_t) offset.simm9;
+                    break;
+                case UNSIGNED_OFFSET:
+                    op->handler = op_transfer_unsigned;
+                    op->imm = (uint64_t) offset.imm12 * (inst->sf ? 8 : 4);
+                    break;
+            }
+            return false;
+        }
+        case LOAD_LITERAL:
+            op->handler = op_load_literal;
+            op->imm = (uint64_t) address + (int64_t) inst->load_literal.simm19 * WORD_BYTES;
+            return false;
+        case BRANCH:
+            switch (inst->branch.operand_type) {
+                case UNCOND_BRANCH:
+                    op->handler = op_branch;
+                    op->imm = branch_target(address, inst->branch.operand.uncond_branch.simm26);
+                    return true;
+                case COND_BRANCH:
+                    op->handler = op_branch_cond;
+                    op->selector = inst->branch.operand.cond_branch.cond;
+                    op->imm = branch_target(address, inst->branch.operand.cond_branch.simm19);
+                    return true;
+                case REGISTER_BRANCH:
+                    break;
+            }
+            op->handler = op_execute;
+            return true;
+        case HALT:
+        case UNKNOWN:
+        default:
+            op->handler = op_execute;
+            return true;
+    }
+}
+
+/*
+    Translates the basic block starting at address into block, stopping
+    after the first instruction that leaves the block or when the block
+    is full.
+*/
+static void translate_block(Core *core, Block *block, uint32_t address) {
+    int num_ops = 0;
+    uint64_t next = address;
+    bool ends_block = false;
+
+    while (!ends_block && num_ops < MAX_BLOCK_OPS && next + WORD_BYTES <= get_memory_size(core->emulator)) {
+        Instruction inst = decode(readmem32(core->emulator, next));
+        ends_block = translate_op(&block->ops[num_ops++], &inst, next);
+        next += WORD_BYTES;
+    }
+    if (num_ops == 0) {
+        // nothing fits before the end of memory: report it through execute()
+        translate_op(&block->ops[num_ops++], &UNKNOWN_INSTRUCTION, address);
+    } else if (!ends_block) {
+        block->ops[num_ops] = (BlockOp) { .handler = op_end };
+    }
+
+    block->generation = core->block_cache->generation;
+    block->start = address;
+    block->end = next;
+    mark_code(core->emulator, address, next - address);
+}
+
+/*
+    Returns the translated block starting at address, translating it
+    on a miss.
+*/
+static const Block *lookup_block(Core *core, uint32_t address) {
+    BlockCache *cache = core->block_cache;
+    Block *block = &cache->blocks[(address / WORD_BYTES) & (BLOCK_CACHE_ENTRIES - 1)];
+    if (block->generation != cache->generation || block->start != address) {
+        translate_block(core, block, address);
+    }
+    return block;
+}
+
+/*
+    Takes an address and a number of bytes written from that address.
+    Invalidates every translated block overlapping the write.
+*/
+void block_invalidate(Core *core, uint32_t address, uint32_t numbytes) {
+    BlockCache *cache = core->block_cache;
+    if (cache == NULL) {
+        return;
+    }
+    uint64_t end = (uint64_t) address + numbytes;
+
+    for (int i = 0; i < BLOCK_CACHE_ENTRIES; i++) {
+        Block *block = &cache->blocks[i];
+        if (block->generation == cache->generation && block->start < end && address < block->end) {
+            block->generation = 0;
+            cache->running_block_stale |= (block == cache->running_block);
+        }
+    }
+}
+
+/*
+    Runs the machine from the current program counter one basic block at
+    a time, dispatching straight through each block's handlers.
+    The block cache is allocated on first use. Returns once the machine halts.
+*/
+void run_blocks(Core *core) {
+    MachineState *machine_state = &core->machine_state;
+    if (core->block_cache == NULL) {
+        core->block_cache = calloc(1, sizeof(BlockCache));
+        if (core->block_cache == NULL) {
+            fprintf(stderr, "run_blocks: ran out of memory\n");
+            exit(1);
+        }
+        core->block_cache->generation = 1;
+    }
+    BlockCache *cache = core->block_cache;
+
+    while (!machine_state->halted) {
+        sync_core_code(core);
+        const Block *block = lookup_block(core, machine_state->program_counter.data);
+        cache->running_block = block;
+        cache->running_block_stale = false;
+
+        machine_state->program_counter.data = block->end;
+        for (const BlockOp *op = block->ops; op->handler(core, op); op++);
+    }
+}
@@ -0,0 +1,257 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../headers/emulator.h"
+#include "../headers/execute.h"
+#include "../headers/fileio.h"
+
+/*
+    Resets every core to its state at power on, starting at address 0
+    with its core ID in X0 so that programs can tell the cores apart.
+*/
+static void reset_cores(Emulator *emulator) {
+    for (int i = 0; i < emulator->num_cores; i++) {
+        Core *core = &emulator->cores[i];
+        init_machine_state(&core->machine_state);
+        write_general_registers(&core->machine_state, 0, core->id);
+        icache_init(core);
+        block_cache_init(core);
+        jit_cache_init(core);
+        atomic_store(&core->code_changed, false);
+        memset(core->class_counts, 0, sizeof(core->class_counts));
+    }
+}
+
+/*
+    Takes the configuration of a new machine, or NULL for the defaults.
+    Returns a powered-on machine with empty memory.
+*/
+Emulator *emulator_create(const EmulatorConfig *config) {
+    int num_cores = config != NULL ? config->num_cores : 1;
+    if (num_cores < 1 || num_cores > MAX_CORES) {
+        fprintf(stderr, "emulator_create: a machine needs between 1 and %d cores, not %d\n", MAX_CORES, num_cores);
+        exit(1);
+    }
+
+    Emulator *emulator = calloc(1, sizeof(Emulator));
+    Core *cores = calloc(num_cores, sizeof(Core));
+    if (emulator == NULL || cores == NULL) {
+        fprintf(stderr, "emulator_create: ran out of memory\n");
+        exit(1);
+    }
+    emulator->cores = cores;
+    emulator->num_cores = num_cores;
+    emulator->execution_mode = config != NULL ? config->execution_mode : INTERPRET;
+    emulator->round_robin = config != NULL && config->round_robin;
+    for (int i = 0; i < num_cores; i++) {
+        cores[i].emulator = emulator;
+        cores[i].id = i;
+    }
+
+    pthread_mutex_init(&emulator->memory.lock, NULL);
+    initmem(emulator, config != NULL ? config->memory_size : MEMORY_SIZE);
+    reset_cores(emulator);
+    return emulator;
+}
+
+/*
+    Resets the machine and loads the binary in filename into memory from
+    address 0, ready to run from the start. Emulators may be reused for
+    any number of programs.
+*/
+void emulator_load(Emulator *emulator, const char *filename) {
+    initmem(emulator, get_memory_size(emulator));
+    reset_cores(emulator);
+    store_file_to_mem(emulator, filename);
+}
+
+/*
+    Sets the file that the output is printed to, or stdout if NULL.
+*/
+void emulator_set_output(Emulator *emulator, const char *output_file) {
+    emulator->output_file = output_file;
+}
+
+/*
+    Sets the trace that records every instruction run, or NULL to stop
+    tracing. While tracing, every instruction is interpreted and the cores
+    take turns on the calling thread, so traces are reproducible.
+*/
+void emulator_set_trace(Emulator *emulator, Trace *trace) {
+    emulator->trace = trace;
+}
+
+/*
+    Sets the profile that counts every instruction run, or NULL to stop
+    profiling. Profiling, like tracing, interprets every instruction with
+    the cores taking turns on the calling thread.
+*/
+void emulator_set_profile(Emulator *emulator, Profile *profile) {
+    emulator->profile = profile;
+}
+
+/*
+    Sets the timing model that the instructions run are charged by, or
+    NULL to stop timing, and clears the counts so far. Timed cores
+    interpret every instruction, so that each is charged as it runs.
+*/
+void emulator_set_timing(Emulator *emulator, const TimingModel *timing) {
+    emulator->timing = timing;
+    for (int i = 0; i < emulator->num_cores; i++) {
+        emulator->cores[i].timed = timing != NULL;
+        memset(emulator->cores[i].class_counts, 0, sizeof(emulator->cores[i].class_counts));
+    }
+}
+
+/*
+    Drops everything the core has cached about code if another core has
+    overwritten code since the core last checked.
+*/
+void sync_core_code(Core *core) {
+    if (atomic_load_explicit(&core->code_changed, memory_order_relaxed)
+        && atomic_exchange_explicit(&core->code_changed, false, memory_order_acquire)) {
+        icache_init(core);
+        block_cache_init(core);
+        jit_cache_init(core);
+    }
+}
+
+/*
+    Runs a single instruction on the core, always through the interpreter.
+    Returns false once the core has halted.
+*/
+static bool step_core(Core *core) {
+    MachineState *machine_state = &core->machine_state;
+    if (machine_state->halted) {
+        return false;
+    }
+    if (atomic_load_explicit(&core->code_changed, memory_order_relaxed)) {
+        sync_core_code(core);
+    }
+    const Instruction *inst = icache_lookup(core);
+    execute(core, inst);
+    increment_pc(machine_state);
+    return !machine_state->halted;
+}
+
+/*
+    Runs a single instruction on the core as step_core does, recording it
+    in the machine's trace and profile, whichever are set.
+*/
+static bool step_instrumented_core(Core *core) {
+    MachineState *machine_state = &core->machine_state;
+    if (machine_state->halted) {
+        return false;
+    }
+    Emulator *emulator = core->emulator;
+    if (emulator->trace != NULL) {
+        trace_step_begin(emulator->trace, core);
+    }
+    sync_core_code(core);
+    uint32_t pc = machine_state->program_counter.data;
+    // copied, as running the instruction may overwrite its cache entry
+    Instruction inst = *icache_lookup(core);
+    // evaluated before running the branch, as a branch to the next instruction looks untaken afterwards
+    bool taken = emulator->profile != NULL && inst.command_format == BRANCH
+        && inst.branch.operand_type == COND_BRANCH
+        && condition_holds(machine_state, inst.branch.operand.cond_branch.cond);
+    execute(core, &inst);
+    increment_pc(machine_state);
+    if (emulator->profile != NULL) {
+        profile_record(emulator->profile, core->id, pc, &inst, taken);
+    }
+    if (emulator->trace != NULL) {
+        trace_step_end(emulator->trace, core);
+    }
+    return !machine_state->halted;
+}
+
+/*
+    Runs the core in the machine's execution mode until it halts.
+    Timed cores are always interpreted.
+*/
+static void *run_core(void *arg) {
+    Core *core = arg;
+    ExecutionMode execution_mode = core->timed ? INTERPRET : core->emulator->execution_mode;
+    if (execution_mode == BLOCKS) {
+        run_blocks(core);
+    } else if (execution_mode == JIT) {
+        run_jit(core);
+    }
+    while (step_core(core));
+    return NULL;
+}
+
+/*
+    Runs a single instruction on each core that has not halted, in order
+    of core ID. Returns false once every core has halted.
+*/
+bool emulator_step(Emulator *emulator) {
+    bool instrumented = emulator->trace != NULL || emulator->profile != NULL;
+    bool (*step)(Core *) = instrumented ? step_instrumented_core : step_core;
+    for (int i = 0; i < emulator->num_cores; i++) {
+        step(&emulator->cores[i]);
+    }
+    return !emulator_halted(emulator);
+}
+
+/*
+    Runs the machine until every core halts, then prints the output.
+    Cores run on a host thread each, or in turn on the calling thread in
+    round-robin mode or while tracing or profiling, which interpret every
+    instruction so that runs are reproducible.
+*/
+void emulator_run(Emulator *emulator) {
+    if (emulator->trace != NULL || emulator->profile != NULL) {
+        while (emulator_step(emulator));
+    } else if (emulator->num_cores == 1) {
+        run_core(&emulator->cores[0]);
+    } else if (emulator->round_robin) {
+        while (emulator_step(emulator));
+    } else {
+        pthread_t threads[MAX_CORES];
+        // core 0 runs on the calling thread
+        for (int i = 1; i < emulator->num_cores; i++) {
+            if (pthread_create(&threads[i], NULL, run_core, &emulator->cores[i]) != 0) {
+                fprintf(stderr, "emulator_run: can't start core %d\n", i);
+                exit(1);
+            }
+        }
+        run_core(&emulator->cores[0]);
+        for (int i = 1; i < emulator->num_cores; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    print_output(emulator, emulator->output_file);
+}
+
+bool emulator_halted(const Emulator *emulator) {
+    for (int i = 0; i < emulator->num_cores; i++) {
+        if (!emulator->cores[i].machine_state.halted) {
+            return false;
+        }
+    }
+    return true;
+}
+
+MachineState *emulator_machine_state(Emulator *emulator, int core) {
+    return &emulator->cores[core].machine_state;
+}
+
+/*
+    Frees the machine along with its memory and caches.
+*/
+void emulator_destroy(Emulator *emulator) {
+    if (emulator == NULL) {
+        return;
+    }
+    freemem(emulator);
+    for (int i = 0; i < emulator->num_cores; i++) {
+        block_cache_free(&emulator->cores[i]);
+        jit_free(&emulator->cores[i]);
+    }
+    pthread_mutex_destroy(&emulator->memory.lock);
+    free(emulator->cores);
+    free(emulator);
+}
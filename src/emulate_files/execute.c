@@ -2,179 +2,121 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include "../headers/emulate.h"
+#include "../headers/emulator.h"
 #include "../headers/execute.h"
-#include "../headers/fileio.h"
 #include "../headers/instructions.h"
 #include "../headers/memory.h"
 #include "../headers/registers.h"
+#include "../headers/trace.h"
 
-static void offset_program_counter(MachineState machine_state, int32_t enc_address) {
+/*
+    Returns the program counter after a branch at pc with word offset
+    enc_address has been taken and the program counter incremented.
+*/
+uint64_t branch_target(uint64_t pc, int32_t enc_address) {
 	int64_t offset = enc_address*4;
-	offset += (machine_state.program_counter.data);
+	offset += pc;
     offset -= 4;
-    write_program_counter(offset);
+    return (uint32_t) offset + (uint64_t) 4;
 }
 
-static void add(unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
+static void offset_program_counter(MachineState *machine_state, int32_t enc_address) {
+    uint64_t target = branch_target(machine_state->program_counter.data, enc_address);
+    write_program_counter(machine_state, target - 4);
+}
+
+static void add(MachineState *machine_state, unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
     uint64_t res = rn_data + op2;
     if (sf == 0) {
-        write_general_registers(rd,(uint32_t)res);
+        write_general_registers(machine_state, rd,(uint32_t)res);
     } else {
-        write_general_registers(rd, res);
+        write_general_registers(machine_state, rd, res);
     }
 }
 
-static void adds(unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
+static void adds(MachineState *machine_state, unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
     uint64_t res = rn_data + op2;
     if (sf == 0) {
         rn_data = (uint32_t) rn_data;
         op2 = (uint32_t) op2;
         res = (uint32_t) res;
     }
-    
-    if (sf == 0) { 
-        set_pstate_flag('N', GET_BIT(res, 31));
-    } else {
-        set_pstate_flag('N', GET_BIT(res, 63));
-    }
-    write_general_registers(rd, res);
-
-    if (res == 0) {
-        // set zero flag to 1
-        set_pstate_flag('Z', 1);
-    } else {
-        // set zero flag to 0
-        set_pstate_flag('Z', 0);
-    }
-
-    if (res < rn_data || res < op2) {
-        // set carry flag to 1
-        set_pstate_flag('C', 1);
-    } else {
-        // set carry flag to 0
-        set_pstate_flag('C', 0);
-    }
+    write_general_registers(machine_state, rd, res);
 
-    if ((rn_data > 0 && op2 > 0 && res < 0) || (rn_data < 0 && op2 < 0 && res > 0)) {
-        // set signed overflow flag to 1
-        set_pstate_flag('V', 1);
-    } else {
-        // set signed overflow flag to 0
-        set_pstate_flag('V', 0);
-    }
+    // NZCV is only worked out if a branch or the final output reads it
+    set_lazy_flags(machine_state, FLAGS_ADD, rn_data, op2, res, sf);
 }
 
-static void sub(unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
+static void sub(MachineState *machine_state, unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
     uint64_t res = rn_data - op2;
     if (sf == 0) {
-        write_general_registers(rd, (uint32_t)res);
+        write_general_registers(machine_state, rd, (uint32_t)res);
     } else {
-        write_general_registers(rd, res);
+        write_general_registers(machine_state, rd, res);
     }
 }
 
-static void subs(unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
+static void subs(MachineState *machine_state, unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
     uint64_t res = rn_data - op2;
-    
     if (sf == 0) {
         op2 = (uint32_t) op2;
         rn_data = (uint32_t) rn_data;
         res = (uint32_t) res;
-
-        set_pstate_flag('N', GET_BIT(res, 31));
-    } else {
-        set_pstate_flag('N', GET_BIT(res, 63));
-    }
-    write_general_registers(rd, res);
-
-    if (res == 0) {
-        // set zero flag to 1
-        set_pstate_flag('Z', 1);
-    } else {
-        // set zero flag to 0
-        set_pstate_flag('Z', 0);
-    }
-
-    unsigned char sign_index = sf ? 63 : 31;
-    bool rn_neg  = GET_BIT(rn_data, sign_index);
-    bool op2_neg = GET_BIT(op2, sign_index);
-    bool res_neg = GET_BIT(res, sign_index);
-
-    if (op2 <= rn_data) {
-        // set carry flag to 1
-        set_pstate_flag('C', 1);
-    } else {
-        // set carry flag to 0
-        set_pstate_flag('C', 0);
     }
+    write_general_registers(machine_state, rd, res);
 
-    if ((rn_neg && !op2_neg && !res_neg) || (!rn_neg && op2_neg && res_neg)) {
-        // set signed overflow flag to 1
-        set_pstate_flag('V', 1);
-    } else {
-        // set signed overflow flag to 0
-        set_pstate_flag('V', 0);
-    }
-}
-
-static void arith_inst_exec(unsigned char opc, unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
-	switch (opc) {
-            case 0: {
-                add(rd, rn_data, op2, sf);
-                break;
-            }
-            case 1: {
-                adds(rd, rn_data, op2, sf);
-                break;
-            }
-            case 2: {
-                sub(rd, rn_data, op2, sf);
-                break;
-            }
-            case 3: {
-                subs(rd, rn_data, op2, sf);
-                break;
-            }
-      }
+    set_lazy_flags(machine_state, FLAGS_SUB, rn_data, op2, res, sf);
 }
 
-static void read_write_mem(MachineState machine_state, unsigned char sdt_l, uint64_t sdt_rt, uint64_t mem_address, unsigned char sdt_sf) {
+// Arithmetic operations indexed by opc.
+const DPFunction arith_functions[] = { add, adds, sub, subs };
+
+/*
+    Loads into or stores from register rt at the given address,
+    using 32- or 64-bit accesses depending on sf.
+*/
+void execute_transfer(Core *core, bool sdt_l, unsigned char sdt_rt, uint64_t mem_address, unsigned char sdt_sf) {
+        MachineState *machine_state = &core->machine_state;
+        if (core->emulator->trace != NULL) {
+            trace_memory(core->emulator->trace, mem_address, !sdt_l, sdt_sf);
+        }
         if (sdt_l == 1) {
             // read from mem 
             // write to rt
 
-            uint64_t data_load = readmem64(mem_address);
-
-            // If in 32-bit mode, make upper bits 0.
+            // In 32-bit mode only the word at the address is read.
+            uint64_t data_load;
             if (sdt_sf == 0) {
-                data_load = (uint32_t) data_load;
+                data_load = readmem32(core->emulator, mem_address);
+            } else {
+                data_load = readmem64(core->emulator, mem_address);
             }
 
-            write_general_registers(sdt_rt, data_load);
+            write_general_registers(machine_state, sdt_rt, data_load);
         } else {
             // read from rt
             // write to mem
 
-            uint64_t data_store = (machine_state.general_registers)[sdt_rt].data;
+            uint64_t data_store = read_general_registers(machine_state, sdt_rt);
             
             // Using the correct write with regards 32- or 64-bit mode.
             if (sdt_sf == 0) {
-                writemem32(mem_address, data_store);
+                writemem32(core, mem_address, data_store);
             } else {
-                writemem64(mem_address, data_store);
+                writemem64(core, mem_address, data_store);
             }
         }
 }
 
 
-static void halt(MachineState machine_state) {
-    char *filename = get_output_file();
-    print_output(&machine_state, filename);
-    exit(0);
+/*
+    Stops the core. The output is printed once every core has halted.
+*/
+static void halt(Core *core) {
+    core->machine_state.halted = true;
 }
 
-static void movn(unsigned char dp_imm_rd, uint64_t wide_move_operand, unsigned char sf) {
+static void movn(MachineState *machine_state, unsigned char dp_imm_rd, uint64_t wide_move_operand, unsigned char wide_move_hw, unsigned char sf) {
     // ~OP by xor with 1111...
     // set all bits to one except imm16 bits (which these are will vary depending on if the imm16 was shifted earlier)
     // in 32 bit case upper 32 bits are all 0 (i.e. zero extended)
@@ -183,22 +125,22 @@ static void movn(unsigned char dp_imm_rd, uint64_t wide_move_operand, unsigned c
     if (sf == 0) {
         wide_move_operand = (uint32_t)wide_move_operand;
     }
-    write_general_registers(dp_imm_rd, wide_move_operand);
+    write_general_registers(machine_state, dp_imm_rd, wide_move_operand);
 }
 
-static void movz(unsigned char dp_imm_rd, uint64_t wide_move_operand, unsigned char sf) {
+static void movz(MachineState *machine_state, unsigned char dp_imm_rd, uint64_t wide_move_operand, unsigned char wide_move_hw, unsigned char sf) {
     if (sf == 0) {
         wide_move_operand = (uint32_t)wide_move_operand;
     }
-    write_general_registers(dp_imm_rd, wide_move_operand);
+    write_general_registers(machine_state, dp_imm_rd, wide_move_operand);
 }
 
-static void movk(MachineState machine_state, unsigned char dp_imm_rd, uint64_t wide_move_operand, unsigned char wide_move_hw, unsigned char sf) {
+static void movk(MachineState *machine_state, unsigned char dp_imm_rd, uint64_t wide_move_operand, unsigned char wide_move_hw, unsigned char sf) {
     // get rd data
     // mask rd data around bits that will be replaced with operand (dependent on wide_move_hw * 16)
     // and with operand bits
     // in 32 bit version zero extend to 64
-    uint64_t wide_move_rd_data = (machine_state.general_registers)[dp_imm_rd].data;
+    uint64_t wide_move_rd_data = read_general_registers(machine_state, dp_imm_rd);
 
     // Get top bits.
     uint64_t new_rd_data = BITMASK(wide_move_rd_data, 16 + (wide_move_hw * 16), 63) << (16 + (wide_move_hw * 16));
@@ -213,10 +155,13 @@ static void movk(MachineState machine_state, unsigned char dp_imm_rd, uint64_t w
         new_rd_data = (uint32_t) new_rd_data;
     }
 
-    write_general_registers(dp_imm_rd, new_rd_data);
+    write_general_registers(machine_state, dp_imm_rd, new_rd_data);
 }
 
-static void dp_imm(MachineState machine_state, Instruction *inst) {
+// Wide move operations indexed by opc; opc 1 is unallocated.
+const WideMoveFunction wide_move_functions[] = { movn, NULL, movz, movk };
+
+static void dp_imm(MachineState *machine_state, const Instruction *inst) {
     DPImmOperandType dpimm_operand_type = (inst->dp_imm).operand_type;
     unsigned char dp_imm_opc = (inst->opc);
     unsigned char dp_imm_rd = (inst->rd);
@@ -236,9 +181,9 @@ static void dp_imm(MachineState machine_state, Instruction *inst) {
             if (dp_imm_sh == 1) {
                 dp_imm_imm12 = dp_imm_imm12 << 12;
             }
-            uint64_t dp_imm_rn_data = (machine_state.general_registers)[dp_imm_rn].data;
+            uint64_t dp_imm_rn_data = read_general_registers(machine_state, dp_imm_rn);
 
-            arith_inst_exec(dp_imm_opc, dp_imm_rd, dp_imm_rn_data, dp_imm_imm12, dp_imm_sf);
+            arith_functions[dp_imm_opc](machine_state, dp_imm_rd, dp_imm_rn_data, dp_imm_imm12, dp_imm_sf);
 
             break;
         }
@@ -248,24 +193,10 @@ static void dp_imm(MachineState machine_state, Instruction *inst) {
 
             uint64_t wide_move_operand = wide_move_imm16 << (wide_move_hw * 16);
 
-            switch (dp_imm_opc) {
-                    // get imm16, hw
-                    // operand = imm16 << (hw * 16)
-                    // In the 32-bit version of the move instuction, hw can only take the values 00 or 01 (representing shifts of 0 or 16 bits)
-                    // ^ separate 32 bit inst? do i need error checks for values that aren't 0 or 1
-
-                    case 0: {
-                        movn(dp_imm_rd, wide_move_operand, dp_imm_sf);
-                        break;
-                    }
-                    case 2: {
-                        movz(dp_imm_rd, wide_move_operand, dp_imm_sf);
-                        break;
-                    }
-                    case 3: {
-                        movk(machine_state, dp_imm_rd, wide_move_operand, wide_move_hw, dp_imm_sf);
-                        break;
-                    }
+            // In the 32-bit version of the move instuction, hw can only take the values 00 or 01 (representing shifts of 0 or 16 bits)
+            WideMoveFunction wide_move = wide_move_functions[dp_imm_opc];
+            if (wide_move != NULL) {
+                wide_move(machine_state, dp_imm_rd, wide_move_operand, wide_move_hw, dp_imm_sf);
             }
             break;
         }    
@@ -273,178 +204,190 @@ static void dp_imm(MachineState machine_state, Instruction *inst) {
 }
 
 
-static void dp_reg(MachineState machine_state, Instruction *inst) {
+/*
+    Computes op2 for a DP (register) instruction from the data in rm:
+    rm is shifted by operand bits as selected by opr, with rotation and
+    bitwise negation only applying to logical instructions.
+*/
+uint64_t shift_operand(uint64_t dp_reg_rm_data, unsigned char dp_reg_opr, unsigned char dp_reg_operand, unsigned char dp_reg_sf) {
+    if (dp_reg_sf == 0) dp_reg_rm_data = (uint32_t) dp_reg_rm_data;
+
+    char dp_reg_shift = BITMASK(dp_reg_opr, 1, 2);
+    // perform shift on rm for cases 00, 01, 10, case 11 only done in logical case
+    // op2 = rm shifted operand many bits
+    switch (dp_reg_shift) {
+        case 0: { 
+            /* lsl */ 
+            dp_reg_rm_data = dp_reg_rm_data << dp_reg_operand;
+            break;
+        }
+        case 1: { 
+            /* lsr */
+            dp_reg_rm_data = dp_reg_rm_data >> dp_reg_operand;
+            break;
+        }
+        case 2: { 
+            /* asr */
+            if (dp_reg_sf == 0) {
+                dp_reg_rm_data = (uint32_t) (((int32_t)dp_reg_rm_data) >> dp_reg_operand);
+            } else {    
+                dp_reg_rm_data = (((int64_t)dp_reg_rm_data) >> dp_reg_operand); 
+            }
+            break;
+        }
+    }
+
+    if (GET_BIT(dp_reg_opr, 3) == 1) {
+        // arithmetic
+        return dp_reg_rm_data;
+    }
+
+    // logical
+    // handle shift case 11
+    // handle case of N = 0,1
+    if (dp_reg_shift == 3) {
+        // ror
+        unsigned char size = dp_reg_sf ? 64 : 32;
+        if (!dp_reg_sf) {
+            dp_reg_operand &= 31; // dp_reg_operand %= 32
+            dp_reg_rm_data = (uint32_t) dp_reg_rm_data;
+        }
+        dp_reg_rm_data = (dp_reg_rm_data >> dp_reg_operand) | (dp_reg_rm_data << (size - dp_reg_operand));
+    }
+
+    if (GET_BIT(dp_reg_opr, 0) == 1) {
+        dp_reg_rm_data = ~dp_reg_rm_data;
+    }
+    return dp_reg_rm_data;
+}
+
+static void write_logical(MachineState *machine_state, unsigned char rd, uint64_t res, unsigned char sf) {
+    if (sf == 0) {
+        res = (uint32_t) res;
+    }
+    write_general_registers(machine_state, rd, res);
+}
+
+static void and(MachineState *machine_state, unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
+    // and / bic
+    write_logical(machine_state, rd, rn_data & op2, sf);
+}
+
+static void orr(MachineState *machine_state, unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
+    // orr / orn
+    write_logical(machine_state, rd, rn_data | op2, sf);
+}
+
+static void eor(MachineState *machine_state, unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
+    // eor / eon
+    write_logical(machine_state, rd, rn_data ^ op2, sf);
+}
+
+static void ands(MachineState *machine_state, unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf) {
+    // ands / bics
+    uint64_t res = rn_data & op2;
+    if (!sf) {
+        res = (uint32_t) res;
+    }
+    // C and V are always cleared
+    set_lazy_flags(machine_state, FLAGS_LOGICAL, rn_data, op2, res, sf);
+
+    write_logical(machine_state, rd, res, sf);
+}
+
+// Logical operations indexed by opc.
+const DPFunction logical_functions[] = { and, orr, eor, ands };
+
+/*
+    Executes madd (or msub when negate is set), writing ra +/- rn * rm to rd.
+*/
+void execute_multiply(MachineState *machine_state, unsigned char rd, uint64_t rn_data, uint64_t rm_data, unsigned char ra, bool negate, unsigned char sf) {
+    uint64_t res;
+    uint64_t multiply_ra_data = read_general_registers(machine_state, ra);
+
+    if (sf == 0) rm_data = (uint32_t) rm_data;
+
+    if (!negate) {
+        // madd
+        res = multiply_ra_data + (rn_data * rm_data);
+    } else {
+        // msub
+        res = multiply_ra_data - (rn_data * rm_data);
+    }
+    
+    if (sf == 0) {
+        res  = (uint32_t)res;
+    }
+
+    write_general_registers(machine_state, rd, res);
+}
+
+static void dp_reg(MachineState *machine_state, const Instruction *inst) {
     unsigned char dp_reg_sf = (inst->sf);
     unsigned char dp_reg_opc = (inst->opc);
-    unsigned char dp_reg_m = (inst->dp_reg).m;
     unsigned char dp_reg_opr = (inst->dp_reg).opr;
-    unsigned char dp_reg_rm = (inst->dp_reg).rm;
     unsigned char dp_reg_operand = (inst->dp_reg).operand;
-    unsigned char dp_reg_rn = (inst->dp_reg).rn;
     unsigned char dp_reg_rd = (inst->rd);
-    uint64_t dp_reg_rn_data = (machine_state.general_registers)[dp_reg_rn].data;
-    uint64_t dp_reg_rm_data = (machine_state.general_registers)[dp_reg_rm].data;
-    static uint64_t res;
-
-    if (dp_reg_sf == 0) dp_reg_rm_data = (uint32_t) dp_reg_rm_data;
+    uint64_t dp_reg_rn_data = read_general_registers(machine_state, (inst->dp_reg).rn);
+    uint64_t dp_reg_rm_data = read_general_registers(machine_state, (inst->dp_reg).rm);
 
-    if (dp_reg_m == 0) {
-        char dp_reg_shift = BITMASK(dp_reg_opr, 1, 2);
+    if ((inst->dp_reg).m == 0) {
         // get data from registers rn, rm
-        // perform shift on rm for cases 00, 01, 10, case 11 only done in logical case
-        // op2 = rm shifted operand many bits
         // then execute instuction Rd = Rn (op) Op2
-        
-        switch (dp_reg_shift) {
-            case 0: { 
-                /* lsl */ 
-                dp_reg_rm_data = dp_reg_rm_data << dp_reg_operand;
-                break;
-            }
-            case 1: { 
-                /* lsr */
-                dp_reg_rm_data = dp_reg_rm_data >> dp_reg_operand;
-                break;
-            }
-            case 2: { 
-                /* asr */
-                if (dp_reg_sf == 0) {
-                    dp_reg_rm_data = (uint32_t) (((int32_t)dp_reg_rm_data) >> dp_reg_operand);
-                } else {    
-                    dp_reg_rm_data = (((int64_t)dp_reg_rm_data) >> dp_reg_operand); 
-                }
-                break;
-            }
-        }
-
+        uint64_t op2 = shift_operand(dp_reg_rm_data, dp_reg_opr, dp_reg_operand, dp_reg_sf);
 
         if (GET_BIT(dp_reg_opr, 3) == 1) {
             // arithmetic
             // same as for dp_imm
-
-            arith_inst_exec(dp_reg_opc, dp_reg_rd, dp_reg_rn_data, dp_reg_rm_data, dp_reg_sf);
+            arith_functions[dp_reg_opc](machine_state, dp_reg_rd, dp_reg_rn_data, op2, dp_reg_sf);
         } else {
             // logical
-            // handle shift case 11
-            // handle case of N = 0,1
-            // logical instuctions
-            if (dp_reg_shift == 3) {
-                // ror
-                unsigned char size = dp_reg_sf ? 64 : 32;
-                if (!dp_reg_sf) {
-                    dp_reg_operand &= 31; // dp_reg_operand %= 32
-                    dp_reg_rm_data = (uint32_t) dp_reg_rm_data;
-                }
-                dp_reg_rm_data = (dp_reg_rm_data >> dp_reg_operand) | (dp_reg_rm_data << (size - dp_reg_operand));
-            }
-
-            if (GET_BIT(dp_reg_opr, 0) == 1) {
-                dp_reg_rm_data = ~dp_reg_rm_data;
-            }
-
-            switch (dp_reg_opc) {
-                case 0: {
-                    // and / bic
-                    res = dp_reg_rn_data & dp_reg_rm_data;
-                    break;
-                }
-                case 1: {
-                    // orr / orn
-                    res = dp_reg_rn_data | dp_reg_rm_data;
-                    break;
-                }
-                case 2: {
-                    // eor / eon
-                    res = dp_reg_rn_data ^ dp_reg_rm_data;
-                    break;
-                }
-                case 3: {
-                    // ands / bics
-                    res = dp_reg_rn_data & dp_reg_rm_data;
-                    // set flags 
-                    if (!dp_reg_sf) {
-                        res = (uint32_t) res;
-                        set_pstate_flag('N', GET_BIT(res, 31));
-                    } else {
-                        set_pstate_flag('N', GET_BIT(res, 63));
-                    }
-
-                    if (res == 0) {
-                        // set zero register Z to 1
-                        set_pstate_flag('Z', 1);
-                    } else {
-                        // set zero register Z to 0
-                        set_pstate_flag('Z', 0);
-                    }
-                    // set registers C and V to 0
-                    set_pstate_flag('C', 0);
-                    set_pstate_flag('V', 0);
-                    break;
-                }
-            }
-
-            if (dp_reg_sf == 0) {
-                res = (uint32_t) res;
-            }
-            write_general_registers(dp_reg_rd, res);
-        } 
+            logical_functions[dp_reg_opc](machine_state, dp_reg_rd, dp_reg_rn_data, op2, dp_reg_sf);
+        }
     } else {
         // multiply
         unsigned char multiply_x = GET_BIT(dp_reg_operand, 5);
         unsigned char multiply_ra = BITMASK(dp_reg_operand, 0, 4);
-
-        uint64_t multiply_ra_data = (machine_state.general_registers)[multiply_ra].data;
-        if (multiply_x == 0) {
-            // madd
-            res = multiply_ra_data + (dp_reg_rn_data * dp_reg_rm_data);
-        } else {
-            // msub
-            res = multiply_ra_data - (dp_reg_rn_data * dp_reg_rm_data);
-        }
-        
-        if (dp_reg_sf == 0) {
-            res  = (uint32_t)res;
-        }
-
-        write_general_registers(dp_reg_rd, res);
+        execute_multiply(machine_state, dp_reg_rd, dp_reg_rn_data, dp_reg_rm_data, multiply_ra, multiply_x, dp_reg_sf);
     }
 }
 
 
-static void sdt(MachineState machine_state, Instruction *inst) {
+static void sdt(Core *core, const Instruction *inst) {
+    MachineState *machine_state = &core->machine_state;
     unsigned char sdt_l = (inst->single_data_transfer).l;
     unsigned char sdt_xn = (inst->single_data_transfer).xn;
     unsigned char sdt_sf = (inst->sf);
     unsigned char sdt_rt = (inst->rt);
-    uint64_t sdt_xn_data = (machine_state.general_registers)[sdt_xn].data;
+    uint64_t sdt_xn_data = read_general_registers(machine_state, sdt_xn);
     SDTOffsetType sdt_type = (inst->single_data_transfer).offset_type;
 
     switch (sdt_type) {
         case REGISTER_OFFSET: {
             unsigned char sdt_xm = (inst->single_data_transfer).offset.xm;
-            uint64_t sdt_xm_data =  (machine_state.general_registers)[sdt_xm].data;
+            uint64_t sdt_xm_data =  read_general_registers(machine_state, sdt_xm);
             uint64_t mem_address = sdt_xm_data + sdt_xn_data;
-            read_write_mem(machine_state, sdt_l, sdt_rt, mem_address, sdt_sf);
+            execute_transfer(core, sdt_l, sdt_rt, mem_address, sdt_sf);
             break;
         }
         case PRE_INDEX_OFFSET: {
             int16_t sdt_simm9 = (inst->single_data_transfer).offset.simm9;
             uint64_t mem_address = sdt_xn_data + sdt_simm9;
-            read_write_mem(machine_state, sdt_l, sdt_rt, mem_address, sdt_sf);
+            execute_transfer(core, sdt_l, sdt_rt, mem_address, sdt_sf);
             if (!sdt_sf) {
                 mem_address = (uint32_t)mem_address;
             }
-            write_general_registers(sdt_xn, mem_address);
+            write_general_registers(machine_state, sdt_xn, mem_address);
             break;
         }
         case POST_INDEX_OFFSET: {
             int16_t sdt_simm9 = (inst->single_data_transfer).offset.simm9;
-            read_write_mem(machine_state, sdt_l, sdt_rt, sdt_xn_data, sdt_sf);
+            execute_transfer(core, sdt_l, sdt_rt, sdt_xn_data, sdt_sf);
             uint64_t mem_address = sdt_xn_data + sdt_simm9;
             if (!sdt_sf) {
                 mem_address = (uint32_t)mem_address;
             }
-            write_general_registers(sdt_xn, mem_address);
+            write_general_registers(machine_state, sdt_xn, mem_address);
             break;
         }
         case UNSIGNED_OFFSET: {
@@ -455,21 +398,43 @@ static void sdt(MachineState machine_state, Instruction *inst) {
             } else {
                 uoffset *= 8;
             }
-            read_write_mem(machine_state, sdt_l, sdt_rt, sdt_xn_data + uoffset, sdt_sf);
+            execute_transfer(core, sdt_l, sdt_rt, sdt_xn_data + uoffset, sdt_sf);
             break;
         }
     }
 }
 
-static void load_lit(MachineState machine_state, Instruction *inst) {
-    uint64_t sdt_pc = (machine_state.program_counter).data;
+static void load_lit(Core *core, const Instruction *inst) {
+    uint64_t sdt_pc = core->machine_state.program_counter.data;
     int32_t sdt_simm19 = (inst->load_literal).simm19;
     unsigned char sdt_rt = (inst->rt);
     unsigned char sdt_sf = (inst->sf);
-    read_write_mem(machine_state, 1, sdt_rt, sdt_pc + sdt_simm19 * 4, sdt_sf);
+    execute_transfer(core, 1, sdt_rt, sdt_pc + sdt_simm19 * 4, sdt_sf);
 }
 
-static void branch(MachineState machine_state, Instruction *inst) {
+/*
+    Evaluates a branch condition code against the pstate flags,
+    evaluating any pending flags first.
+    Unrecognised condition codes never hold.
+*/
+bool condition_holds(MachineState *machine_state, unsigned char cond) {
+    const ProcessorStateRegister *pstate = read_pstate(machine_state);
+    switch (cond) {
+        case 0:  return pstate->zero == 1;
+        case 1:  return pstate->zero == 0;
+        case 10: return pstate->neg == pstate->overflow;
+        case 11: return pstate->neg != pstate->overflow;
+        case 12: return pstate->zero == 0 && pstate->neg == pstate->overflow;
+        case 13: return !(pstate->zero == 0 && pstate->neg == pstate->overflow);
+        case 14: return true;
+        default: return false;
+    }
+}
+
+/*
+    Runs a branch. Returns whether it was taken.
+*/
+static bool branch(MachineState *machine_state, const Instruction *inst) {
     // decrement pc when editing
     // how to specify PC when writing to machine state
 
@@ -488,89 +453,60 @@ static void branch(MachineState machine_state, Instruction *inst) {
             unsigned char register_branch_xn = (inst->branch).operand.register_branch.xn;
             // since the program counter increments by 4 on a fetch, we need to subtract 4
             // to the new address
-            uint64_t branch_pc = (machine_state.general_registers)[register_branch_xn].data - 4;
-            write_program_counter(branch_pc);
+            uint64_t branch_pc = read_general_registers(machine_state, register_branch_xn) - 4;
+            write_program_counter(machine_state, branch_pc);
             break;
         }
         case COND_BRANCH: {
-                char eval_cond = (inst->branch).operand.cond_branch.cond;
-                ProcessorStateRegister branch_pstate = (machine_state.pstate);
-                switch (eval_cond) {
-                    case 0: {
-                        if (branch_pstate.zero == 1) {
-                            offset_program_counter(machine_state, (inst->branch).operand.cond_branch.simm19);
-                        }
-                        break;
-                    }
-                    case 1: {
-                        if (branch_pstate.zero == 0) {
-                            offset_program_counter(machine_state, (inst->branch).operand.cond_branch.simm19);
-                        }
-                        break;
-                    }
-                    case 10: {
-                        if (branch_pstate.neg == branch_pstate.overflow) {
-                            offset_program_counter(machine_state, (inst->branch).operand.cond_branch.simm19);
-                        }
-                        break;
-                    }
-                    case 11: {
-                        if (branch_pstate.neg != branch_pstate.overflow) {
-                            offset_program_counter(machine_state, (inst->branch).operand.cond_branch.simm19);
-                        }
-                        break;
-                    }
-                    case 12: {
-                        if (branch_pstate.zero == 0 && branch_pstate.neg == branch_pstate.overflow) {
-                            offset_program_counter(machine_state, (inst->branch).operand.cond_branch.simm19);
-                        }
-                        break;
-                    }
-                    case 13: {
-                        if (!(branch_pstate.zero == 0 && branch_pstate.neg == branch_pstate.overflow)) {
-                            offset_program_counter(machine_state, (inst->branch).operand.cond_branch.simm19);
-                        }
-                        break;
-                    }
-                    case 14: {
-                        offset_program_counter(machine_state, (inst->branch).operand.cond_branch.simm19);
-                        break;
-                    }
-                }
-                break;
+            unsigned char eval_cond = (inst->branch).operand.cond_branch.cond;
+            if (!condition_holds(machine_state, eval_cond)) {
+                return false;
             }
+            offset_program_counter(machine_state, (inst->branch).operand.cond_branch.simm19);
+            break;
+        }
     }
+    return true;
 }
 
-void execute(Instruction *inst) {
+// Counts an instruction of the given class against the core, if its time is being modelled.
+#define CHARGE(core, class) do { if ((core)->timed) (core)->class_counts[(class)]++; } while (0)
+
+void execute(Core *core, const Instruction *inst) {
     if (inst == NULL) return;
+    MachineState *machine_state = &core->machine_state;
     CommandFormat inst_command_format = inst->command_format;
 
-    MachineState machine_state = read_machine_state();
-
     switch (inst_command_format) {
     	case HALT: {
-            halt(machine_state);
+            // HALT is encoded as a register AND
+            CHARGE(core, CLASS_DP_REG);
+            halt(core);
             break;
         }
         case DP_IMM: {
+            CHARGE(core, CLASS_DP_IMM);
             dp_imm(machine_state, inst);	    
             break;
         }
         case DP_REG: {
+            CHARGE(core, (inst->dp_reg).m ? CLASS_MULTIPLY : CLASS_DP_REG);
 		    dp_reg(machine_state, inst);
             break;
         }
 	    case SINGLE_DATA_TRANSFER: {
-            sdt(machine_state, inst);
+            CHARGE(core, CLASS_SDT);
+            sdt(core, inst);
             break;
         }
         case LOAD_LITERAL: {
-            load_lit(machine_state, inst);
+            CHARGE(core, CLASS_LOAD_LITERAL);
+            load_lit(core, inst);
             break;
         }
         case BRANCH: {
-            branch(machine_state, inst);
+            bool taken = branch(machine_state, inst);
+            CHARGE(core, taken ? CLASS_BRANCH_TAKEN : CLASS_BRANCH_UNTAKEN);
 	        break;
         }
         case UNKNOWN: {
@@ -1,23 +1,21 @@
 #include <stdlib.h>
 #include <assert.h>
 #include "../headers/fetch.h"
+#include "../headers/emulator.h"
 #include "../headers/memory.h"
 
 /*
-    A function that takes the address held in the Program Counter
-    and returns the Instruction held at that address
+    A function that takes a core, reads the address held in its
+    Program Counter and returns the Instruction held at that address
 */
-uint32_t fetch(MachineState *machine_state) {
-    assert(machine_state != NULL);
+uint32_t fetch(Core *core) {
+    assert(core != NULL);
 
     // Reads the address held in the Program Counter
-    Register pc = machine_state->program_counter;
+    Register pc = core->machine_state.program_counter;
     uint32_t pc_address = pc.data; // Only takes the lower bits
-    uint32_t instruction = readmem32(pc_address);
+    uint32_t instruction = readmem32(core->emulator, pc_address);
 
     // Return the instruction
     return instruction;
 }
-
-
-
@@ -1,143 +1,195 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../headers/emulator.h"
 #include "../headers/fileio.h"
 #include "../headers/memory.h"
 #define WORD_SIZE 4
 
 /*
-    Takes a FILE *fileptr and a long int *size.
-    Stores the size of file (in bytes) in size.
+    Takes a string that specifies a file location.
+    Maps the file copy-on-write into memory from address 0, so that
+    its pages are only read in as the program touches them.
 */
-static void filesize(FILE *fileptr, long int *size) {
-    if (fseek(fileptr, 0, SEEK_END)) {
-        fprintf(stderr, "filesize: fseek error, errno %d\n", errno);
+void store_file_to_mem(Emulator *emulator, const char *filename) {
+    // Open file and check if it opens successfully.
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "store_file_to_mem: can't open %s, errno %d\n", filename, errno);
         exit(1);
     }
 
-    if ((*size = ftell(fileptr)) < 0) {
-        fprintf(stderr, "filesize: ftell error, errno %d\n", errno);
+    // Find the file size, which must fit in memory.
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0) {
+        fprintf(stderr, "store_file_to_mem: can't stat %s, errno %d\n", filename, errno);
         exit(1);
     }
-
-    if (fseek(fileptr, 0, SEEK_SET)) {
-        fprintf(stderr, "filesize: fseek error, errno  %d\n", errno);
+    uint64_t size = file_stat.st_size;
+    if (size > get_memory_size(emulator)) {
+        fprintf(stderr, "store_file_to_mem: %s is larger than memory\n", filename);
         exit(1);
     }
+
+    // An empty program leaves memory zeroed.
+    if (size > 0) {
+        // Writes go to private copies of the pages, never to the file.
+        void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            fprintf(stderr, "store_file_to_mem: can't map %s, errno %d\n", filename, errno);
+            exit(1);
+        }
+        maptomem(emulator, mapping, size);
+    }
+
+    // The mapping stays valid once the file is closed.
+    close(fd);
 }
 
+// OUTPUT FILE
+// Size of the buffer that the output is gathered in before being written.
+#define OUTPUT_BUFFER_SIZE 65536
+
 /*
-    Takes a string that specifies a file location.
-    Returns a char array with the contents of that file.
+    The output file, written through a single buffer so that the whole
+    output costs a handful of writes rather than a call per line.
 */
-void store_file_to_mem(char *filename) {
-    // Define array to return.
-    char *arr;
+typedef struct {
+    FILE *file;
+    size_t used;
+    char data[OUTPUT_BUFFER_SIZE];
+} OutputBuffer;
 
-    // Open file and check if it opens successfully.
-    FILE *fileptr = fopen(filename, "r");
-    if (fileptr == NULL) {
-        fprintf(stderr, "store_file_to_arr: can’t open %s, errno %d\n", filename, errno);
-        exit(1);
-    }
-
-    // Store filesize in size.
-    long int size;
-    filesize(fileptr, &size);
-
-    // Allocate memory to arr and check if allocation is successful.
-    arr = malloc(size);
-    if (arr == NULL) {
-        fprintf(stderr, "store_file_to_arr: ran out of memory, errno %d\n", errno);
-        exit(1);
+/*
+    A function that writes out everything buffered so far, flagging
+    errors (to help with file writing errors)
+*/
+static void flush_output(OutputBuffer *output) {
+    if (output->used > 0 && fwrite(output->data, 1, output->used, output->file) != output->used) {
+        fprintf(stderr, "flush_output: couldn't write output, errno %d\n", errno);
     }
+    output->used = 0;
+}
 
-    // Read file into arr.
-    fread(arr, 1, size, fileptr);
-    if (ferror(fileptr)) {
-        fprintf(stderr, "store_file_to_arr: can't read %s, errno %d\n", filename, errno);
+static void write_chars(OutputBuffer *output, const char *chars, size_t length) {
+    if (output->used + length > OUTPUT_BUFFER_SIZE) {
+        flush_output(output);
     }
+    memcpy(output->data + output->used, chars, length);
+    output->used += length;
+}
 
-    // Close file.
-    fclose(fileptr);
-
-    // Load arr to memory and free the space created by malloc.
-    loadtomem(arr, size);
-    free(arr);
+static void write_string(OutputBuffer *output, const char *string) {
+    write_chars(output, string, strlen(string));
 }
 
-// OUTPUT FILE
 /*
-    A function that executes printf but flags errors (to help with
-    file writing errors)
+    A function that writes value as a fixed number of lowercase hex digits
 */
-static void printf_with_err(char *output, ...) {
-    int ret;
-
-    va_list myargs;
-    va_start(myargs, output);
-
-    ret = vprintf(output, myargs);
-
-    va_end(myargs);
-
-    if (ret < 0) {
-	fprintf(stderr, "printf_with_err: couldn't print instruction of format %s", output);
+static void write_hex(OutputBuffer *output, uint64_t value, int digits) {
+    static const char hex_digits[] = "0123456789abcdef";
+    char chars[16];
+    for (int i = digits - 1; i >= 0; i--) {
+        chars[i] = hex_digits[value & 0xf];
+        value >>= 4;
     }
+    write_chars(output, chars, digits);
 }
 
 /*
-    A function that locates memory locations with non-zero data
-    and prints them for the output file
+    A function that prints the non-zero words of a written page
+    to the output buffer passed as context
 */
-static void locate_non_zero_mem(void) {
-    for (int i = 0; i < MEMORY_SIZE; i += WORD_SIZE) {
-        uint32_t data = readmem32(i);
+static void write_non_zero_words(uint64_t address, const unsigned char *bytes, void *context) {
+    OutputBuffer *output = context;
+    for (int i = 0; i < PAGE_SIZE; i += WORD_SIZE) {
+        uint32_t data = bytes[i] | bytes[i + 1] << 8 | bytes[i + 2] << 16 | (uint32_t) bytes[i + 3] << 24;
         if (data != 0) {
-            printf_with_err("%08x: %08x\n", i, data);
+            write_hex(output, address + i, 8);
+            write_string(output, ": ");
+            write_hex(output, data, 8);
+            write_string(output, "\n");
         }
     }
 }
 
 /*
-    A function that puts the final outputs of the registers, condition
-    flags and memory into stdout
+    A function that writes the registers and condition flags of a core
 */
-void print_output(MachineState *machine_state, char *filename) {
-    // Write to the file if it exists
-    FILE *output;
-    if (filename != NULL) {
-	output = freopen(filename, "w", stdout);
-	if (output == NULL) {
-	    fprintf(stderr, "print_output: can't open %s, errno %d\n", filename, errno);
-	}
-}
-
+static void write_core(OutputBuffer *output, MachineState *machine_state) {
     // Printing register content
-    printf_with_err("Registers:\n");
+    write_string(output, "Registers:\n");
 
     // Prints the output of each general register
     for (int i = 0; i < NUM_GENERAL_REGISTERS; i++) {
-	Register gen_reg = machine_state->general_registers[i];
-	printf_with_err("X%02d = %016llx\n", i, gen_reg.data);
+        char name[] = { 'X', '0' + i / 10, '0' + i % 10, '\0' };
+        write_string(output, name);
+        write_string(output, " = ");
+        write_hex(output, machine_state->general_registers[i].data, 16);
+        write_string(output, "\n");
     }
 
     // Prints the output of the program counter
-    Register pc = machine_state->program_counter;
-    printf_with_err("PC = %016x\n", pc.data);
+    write_string(output, "PC = ");
+    write_hex(output, (uint32_t) machine_state->program_counter.data, 16);
+    write_string(output, "\n");
 
     // Prints condition flags in PSTATE
-    ProcessorStateRegister pstate = machine_state->pstate;
-    printf_with_err("PSTATE : %c%c%c%c\n", pstate.neg ? 'N' : '-', pstate.zero ? 'Z' : '-', pstate.carry ? 'C' : '-', pstate.overflow ? 'V' : '-');
+    ProcessorStateRegister pstate = *read_pstate(machine_state);
+    char flags[] = { pstate.neg ? 'N' : '-', pstate.zero ? 'Z' : '-', pstate.carry ? 'C' : '-', pstate.overflow ? 'V' : '-', '\0' };
+    write_string(output, "PSTATE : ");
+    write_string(output, flags);
+    write_string(output, "\n");
+}
+
+/*
+    A function that puts the final outputs of the registers, condition
+    flags and memory into stdout, or into filename if it is given.
+    A machine with several cores prints each core in turn, headed by its ID.
+*/
+void print_output(Emulator *emulator, const char *filename) {
+    OutputBuffer *output = malloc(sizeof(OutputBuffer));
+    if (output == NULL) {
+        fprintf(stderr, "print_output: ran out of memory\n");
+        exit(1);
+    }
 
-    // Printing non-zero memory
-    printf_with_err("Non-zero memory:\n");
+    // Write to the file if it exists
+    output->file = stdout;
+    output->used = 0;
+    if (filename != NULL) {
+        output->file = fopen(filename, "w");
+        if (output->file == NULL) {
+            fprintf(stderr, "print_output: can't open %s, errno %d\n", filename, errno);
+            exit(1);
+        }
+    }
+
+    if (emulator->num_cores == 1) {
+        write_core(output, &emulator->cores[0].machine_state);
+    } else {
+        for (int i = 0; i < emulator->num_cores; i++) {
+            char id[32];
+            snprintf(id, sizeof(id), "Core %d:\n", i);
+            write_string(output, id);
+            write_core(output, &emulator->cores[i].machine_state);
+        }
+    }
 
-    // Locates non-zero memory and prints the data
-    locate_non_zero_mem();
+    // Printing non-zero memory, which can only be in pages that were written
+    write_string(output, "Non-zero memory:\n");
+    visit_written_pages(emulator, write_non_zero_words, output);
 
+    flush_output(output);
     if (filename != NULL) {
-	fclose(output);
+        fclose(output->file);
+    } else {
+        fflush(stdout);
     }
+    free(output);
 }
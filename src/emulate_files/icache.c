@@ -0,0 +1,62 @@
+#include <stdbool.h>
+#include <string.h>
+#include "../headers/icache.h"
+#include "../headers/decode.h"
+#include "../headers/emulator.h"
+#include "../headers/fetch.h"
+#include "../headers/memory.h"
+
+#define WORD_BYTES 4
+#define ICACHE_INDEX(address) (((address) / WORD_BYTES) & (ICACHE_ENTRIES - 1))
+
+/*
+    Marks every entry in the cache as invalid. Only the generation is
+    bumped, so this is cheap enough to call before every program.
+*/
+void icache_init(Core *core) {
+    ICache *icache = &core->icache;
+    if (++icache->generation == 0) {
+        memset(icache->entries, 0, sizeof(icache->entries));
+        icache->generation = 1;
+    }
+}
+
+/*
+    Takes a core and returns a pointer to the decoded instruction
+    at the address held in the Program Counter, fetching and decoding it
+    on a miss. The pointer is only valid until the next call to
+    icache_lookup or icache_invalidate.
+*/
+const Instruction *icache_lookup(Core *core) {
+    ICache *icache = &core->icache;
+    uint32_t address = core->machine_state.program_counter.data;
+    ICacheEntry *entry = &icache->entries[ICACHE_INDEX(address)];
+
+    if (entry->generation != icache->generation || entry->tag != address) {
+        entry->inst = decode(fetch(core));
+        mark_code(core->emulator, address, WORD_BYTES);
+        entry->tag = address;
+        entry->generation = icache->generation;
+    }
+
+    return &entry->inst;
+}
+
+/*
+    Takes an address and a number of bytes written from that address.
+    Invalidates any cached instruction whose encoding overlaps the write,
+    so that self-modifying code is re-decoded on its next fetch.
+*/
+void icache_invalidate(Core *core, uint32_t address, uint32_t numbytes) {
+    ICache *icache = &core->icache;
+    // An instruction starting up to 3 bytes before the write still overlaps it.
+    uint32_t first = address < WORD_BYTES ? 0 : address - (WORD_BYTES - 1);
+    uint32_t last = address + numbytes - 1;
+
+    for (uint32_t word = first / WORD_BYTES; word <= last / WORD_BYTES; word++) {
+        ICacheEntry *entry = &icache->entries[word & (ICACHE_ENTRIES - 1)];
+        if (entry->generation == icache->generation && entry->tag + WORD_BYTES > address && entry->tag <= last) {
+            entry->generation = 0;
+        }
+    }
+}
@@ -0,0 +1,730 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "../headers/decode.h"
+#include "../headers/emulator.h"
+#include "../headers/execute.h"
+#include "../headers/icache.h"
+#include "../headers/instructions.h"
+#include "../headers/jit.h"
+#include "../headers/memory.h"
+
+#define WORD_BYTES 4
+#define JIT_INDEX(address) (((address) / WORD_BYTES) & (JIT_CACHE_ENTRIES - 1))
+
+// Compiled code takes the core and returns once it leaves the block.
+typedef void (*JitFunction)(Core *core);
+
+/*
+    An entry point into guest code. Entries count how often they are
+    branched to, and are compiled to native code once they become hot.
+    An entry that cannot be compiled is left to the interpreter.
+*/
+typedef struct {
+    uint32_t start;
+    // address just past the last compiled instruction
+    uint64_t end;
+    uint32_t hits;
+    bool compiled;
+    bool uncompilable;
+    JitFunction code;
+} JitBlock;
+
+struct jit_state {
+    JitBlock cache[JIT_CACHE_ENTRIES];
+    // Executable buffer holding compiled code, or NULL without a backend.
+    unsigned char *buffer;
+    size_t buffer_used;
+    // The block currently being run, and whether a store has overwritten it.
+    const JitBlock *running_block;
+    bool running_block_stale;
+};
+
+/*
+    Clears every entry, and with them all compiled code.
+*/
+static void jit_reset(JitState *jit) {
+    memset(jit->cache, 0, sizeof(jit->cache));
+    jit->buffer_used = 0;
+    jit->running_block = NULL;
+    jit->running_block_stale = false;
+}
+
+/*
+    Clears the JIT cache ready for a new program, if one was ever allocated.
+*/
+void jit_cache_init(Core *core) {
+    if (core->jit != NULL) {
+        jit_reset(core->jit);
+    }
+}
+
+/*
+    Frees the JIT cache and its executable buffer.
+*/
+void jit_free(Core *core) {
+    JitState *jit = core->jit;
+    if (jit == NULL) {
+        return;
+    }
+    if (jit->buffer != NULL) {
+        munmap(jit->buffer, JIT_BUFFER_SIZE);
+    }
+    free(jit);
+    core->jit = NULL;
+}
+
+/*
+    Takes an address and a number of bytes written from that address.
+    Drops every compiled block overlapping the write.
+*/
+void jit_invalidate(Core *core, uint32_t address, uint32_t numbytes) {
+    JitState *jit = core->jit;
+    if (jit == NULL) {
+        return;
+    }
+    uint64_t end = (uint64_t) address + numbytes;
+    for (int i = 0; i < JIT_CACHE_ENTRIES; i++) {
+        JitBlock *block = &jit->cache[i];
+        if ((block->compiled || block->uncompilable) && block->start < end && address < block->end) {
+            jit->running_block_stale |= (block == jit->running_block);
+            *block = (JitBlock) { .start = block->start };
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+/* An x86-64 backend.
+ * Compiled blocks keep the core pointer in rbx and use rax, rcx,
+ * rdx, r8 and r12 as scratch registers. Guest registers live in the
+ * MachineState and are loaded and stored around each instruction.
+ * The emitter's state is per thread, so cores on different threads
+ * can compile at the same time. */
+
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7, R8 = 8, R12 = 12 };
+
+// x86 condition codes, for setcc
+enum { CC_O = 0x0, CC_C = 0x2, CC_NC = 0x3, CC_Z = 0x4, CC_S = 0x8 };
+
+// /digit extensions for the group 1 (arithmetic) and group 2 (shift) opcodes
+enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6 };
+enum { SHIFT_ROR = 1, SHIFT_SHL = 4, SHIFT_SHR = 5, SHIFT_SAR = 7 };
+
+// Opcodes of the register to register/memory forms of the group 1 operations.
+static const unsigned char alu_rr_opcodes[] = {
+    [ALU_ADD] = 0x01, [ALU_OR] = 0x09, [ALU_AND] = 0x21, [ALU_SUB] = 0x29, [ALU_XOR] = 0x31
+};
+
+// Bit positions of the flags within the pstate byte, found in backend_init.
+static _Thread_local int zero_bit, neg_bit, carry_bit, overflow_bit;
+
+// Current position and end of the code being emitted.
+static _Thread_local unsigned char *cursor;
+static _Thread_local unsigned char *cursor_limit;
+
+static void emit8(unsigned char byte) {
+    if (cursor < cursor_limit) {
+        *cursor = byte;
+    }
+    // keep counting past the limit so overflow can be detected
+    cursor++;
+}
+
+static void emit32(uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        emit8(value >> (8 * i));
+    }
+}
+
+static void emit64(uint64_t value) {
+    emit32(value);
+    emit32(value >> 32);
+}
+
+// Emits a REX prefix if the operand size or either register needs one.
+static void emit_rex(bool wide, int reg, int rm) {
+    unsigned char rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3);
+    if (rex != 0x40) emit8(rex);
+}
+
+// ModRM byte for a register direct operand.
+static void emit_modrm_reg(int reg, int rm) {
+    emit8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// ModRM byte and displacement for the operand [rbx + disp].
+static void emit_modrm_state(int reg, int32_t disp) {
+    emit8(0x80 | ((reg & 7) << 3) | RBX);
+    emit32(disp);
+}
+
+#define STATE_OFFSET offsetof(Core, machine_state)
+
+static int32_t register_offset(int index) {
+    return STATE_OFFSET + offsetof(MachineState, general_registers) + index * sizeof(Register) + offsetof(Register, data);
+}
+
+#define PC_OFFSET     ((int32_t) (STATE_OFFSET + offsetof(MachineState, program_counter) + offsetof(Register, data)))
+#define PSTATE_OFFSET ((int32_t) (STATE_OFFSET + offsetof(MachineState, pstate)))
+
+// reg = guest register index, reading zero for the zero register
+static void emit_load_guest(int reg, int index) {
+    if (index == NUM_GENERAL_REGISTERS) {
+        // xor reg32, reg32
+        emit_rex(false, reg, reg);
+        emit8(0x31);
+        emit_modrm_reg(reg, reg);
+        return;
+    }
+    emit_rex(true, reg, RBX);
+    emit8(0x8B);
+    emit_modrm_state(reg, register_offset(index));
+}
+
+// guest register index = reg, ignoring writes to the zero register
+static void emit_store_guest(int reg, int index) {
+    if (index == NUM_GENERAL_REGISTERS) return;
+    emit_rex(true, reg, RBX);
+    emit8(0x89);
+    emit_modrm_state(reg, register_offset(index));
+}
+
+static void emit_mov_imm64(int reg, uint64_t value) {
+    emit_rex(true, 0, reg);
+    emit8(0xB8 + (reg & 7));
+    emit64(value);
+}
+
+static void emit_mov_imm32(int reg, uint32_t value) {
+    emit_rex(false, 0, reg);
+    emit8(0xB8 + (reg & 7));
+    emit32(value);
+}
+
+// dst = src; a 32-bit move zero-extends into the upper half
+static void emit_mov(bool wide, int dst, int src) {
+    emit_rex(wide, src, dst);
+    emit8(0x89);
+    emit_modrm_reg(src, dst);
+}
+
+static void emit_alu(int operation, bool wide, int dst, int src) {
+    emit_rex(wide, src, dst);
+    emit8(alu_rr_opcodes[operation]);
+    emit_modrm_reg(src, dst);
+}
+
+static void emit_alu_imm(int operation, bool wide, int dst, int32_t imm) {
+    emit_rex(wide, 0, dst);
+    emit8(0x81);
+    emit_modrm_reg(operation, dst);
+    emit32(imm);
+}
+
+static void emit_shift_imm(int operation, bool wide, int reg, unsigned char amount) {
+    emit_rex(wide, 0, reg);
+    emit8(0xC1);
+    emit_modrm_reg(operation, reg);
+    emit8(amount);
+}
+
+static void emit_not(int reg) {
+    emit_rex(true, 0, reg);
+    emit8(0xF7);
+    emit_modrm_reg(2, reg);
+}
+
+// dst = dst * src, keeping the low 64 bits
+static void emit_imul(int dst, int src) {
+    emit_rex(true, dst, src);
+    emit8(0x0F);
+    emit8(0xAF);
+    emit_modrm_reg(dst, src);
+}
+
+static void emit_setcc(int cc, int reg) {
+    emit_rex(false, 0, reg);
+    emit8(0x0F);
+    emit8(0x90 | cc);
+    emit_modrm_reg(0, reg);
+}
+
+// dst = (uint32_t) low byte of src, shifted left by bit
+static void emit_flag_bit(int dst, int src, int bit) {
+    emit_rex(false, dst, src);
+    emit8(0x0F);
+    emit8(0xB6);
+    emit_modrm_reg(dst, src);
+    emit_shift_imm(SHIFT_SHL, false, dst, bit);
+}
+
+/*
+    Stores N, Z, C (and V when has_overflow is set) from the host flags
+    into pstate. C is taken from the host borrow for subtraction.
+    Without has_overflow V is cleared, matching adds() and ands().
+*/
+static void emit_pstate_flags(bool subtract, bool has_overflow) {
+    emit_setcc(CC_Z, RAX);
+    emit_setcc(CC_S, RCX);
+    emit_setcc(subtract ? CC_NC : CC_C, RDX);
+    if (has_overflow) emit_setcc(CC_O, R8);
+
+    emit_flag_bit(RAX, RAX, zero_bit);
+    emit_flag_bit(RCX, RCX, neg_bit);
+    emit_alu(ALU_OR, false, RAX, RCX);
+    emit_flag_bit(RCX, RDX, carry_bit);
+    emit_alu(ALU_OR, false, RAX, RCX);
+    if (has_overflow) {
+        emit_flag_bit(RCX, R8, overflow_bit);
+        emit_alu(ALU_OR, false, RAX, RCX);
+    }
+    // mov byte [rbx + pstate], al
+    emit8(0x88);
+    emit_modrm_state(RAX, PSTATE_OFFSET);
+}
+
+static void emit_prologue(void) {
+    emit8(0x53);                               // push rbx
+    emit8(0x41); emit8(0x54);                  // push r12
+    emit8(0x48); emit8(0x83); emit8(0xEC); emit8(0x08); // sub rsp, 8
+    emit_mov(true, RBX, RDI);
+}
+
+static void emit_epilogue(void) {
+    emit8(0x48); emit8(0x83); emit8(0xC4); emit8(0x08); // add rsp, 8
+    emit8(0x41); emit8(0x5C);                  // pop r12
+    emit8(0x5B);                               // pop rbx
+    emit8(0xC3);                               // ret
+}
+
+// Sets the program counter to the value in rax and returns from the block.
+static void emit_exit_rax(void) {
+    emit_rex(true, RAX, RBX);
+    emit8(0x89);
+    emit_modrm_state(RAX, PC_OFFSET);
+    emit_epilogue();
+}
+
+// Sets the program counter to address and returns from the block.
+static void emit_exit(uint64_t address) {
+    emit_mov_imm64(RAX, address);
+    emit_exit_rax();
+}
+
+/*
+    Performs a transfer for compiled code.
+    Returns whether the transfer overwrote the block being run.
+*/
+static bool jit_transfer(Core *core, bool load, unsigned char rt, uint64_t address, unsigned char sf) {
+    execute_transfer(core, load, rt, address, sf);
+    return core->jit->running_block_stale;
+}
+
+static void emit_call(void (*function)(void)) {
+    uint64_t address;
+    memcpy(&address, &function, sizeof(address));
+    emit_mov_imm64(RAX, address);
+    emit8(0xFF); emit8(0xD0);                  // call rax
+}
+
+/*
+    Emits a call to jit_transfer with the address held in rcx.
+    After a store, leaves the block at next if the store overwrote it.
+*/
+static void emit_transfer(const Instruction *inst, bool load, uint64_t next, int writeback_reg) {
+    emit_mov(true, RDI, RBX);
+    emit_mov_imm32(RSI, load);
+    emit_mov_imm32(RDX, inst->rt);
+    emit_mov_imm32(R8, inst->sf);
+    emit_call((void (*)(void)) jit_transfer);
+
+    if (writeback_reg >= 0) {
+        if (!inst->sf) emit_mov(false, writeback_reg, writeback_reg);
+        emit_store_guest(writeback_reg, inst->single_data_transfer.xn);
+    }
+
+    if (!load) {
+        // test al, al; jz over the exit
+        emit8(0x84); emit8(0xC0);
+        emit8(0x74);
+        unsigned char *displacement = cursor;
+        emit8(0);
+        emit_exit(next);
+        if (displacement < cursor_limit) *displacement = cursor - displacement - 1;
+    }
+}
+
+/*
+    Emits code into rcx computing op2 for a DP (register) instruction,
+    as shift_operand() does.
+*/
+static void emit_shift_operand(const Instruction *inst) {
+    unsigned char opr = inst->dp_reg.opr;
+    unsigned char amount = inst->dp_reg.operand;
+    bool logical = !GET_BIT(opr, 3);
+
+    emit_load_guest(RCX, inst->dp_reg.rm);
+    if (!inst->sf) emit_mov(false, RCX, RCX);
+
+    switch (BITMASK(opr, 1, 2)) {
+        case 0: emit_shift_imm(SHIFT_SHL, true, RCX, amount); break;
+        case 1: emit_shift_imm(SHIFT_SHR, true, RCX, amount); break;
+        case 2: emit_shift_imm(SHIFT_SAR, inst->sf, RCX, amount); break;
+        case 3:
+            if (logical) {
+                emit_shift_imm(SHIFT_ROR, inst->sf, RCX, inst->sf ? amount : amount & 31);
+            }
+            break;
+    }
+    if (logical && GET_BIT(opr, 0)) emit_not(RCX);
+}
+
+// Emits rax = rax (op) rcx for an arithmetic opc, setting flags for adds and subs.
+static void emit_arith(const Instruction *inst, int rd) {
+    bool subtract = inst->opc >= 2;
+    emit_alu(subtract ? ALU_SUB : ALU_ADD, inst->sf, RAX, RCX);
+    emit_store_guest(RAX, rd);
+    if (inst->opc & 1) emit_pstate_flags(subtract, subtract);
+}
+
+static bool emit_dp_imm(const Instruction *inst) {
+    if (inst->dp_imm.operand_type == ARITH_OPERAND) {
+        uint32_t imm12 = inst->dp_imm.operand.arith_operand.imm12;
+        uint32_t op2 = inst->dp_imm.operand.arith_operand.sh ? imm12 << 12 : imm12;
+        emit_load_guest(RAX, inst->dp_imm.operand.arith_operand.rn);
+        emit_mov_imm32(RCX, op2);
+        emit_arith(inst, inst->rd);
+        return true;
+    }
+
+    unsigned char hw = inst->dp_imm.operand.wide_move_operand.hw;
+    uint64_t operand = (uint64_t) inst->dp_imm.operand.wide_move_operand.imm16 << (hw * 16);
+    switch (inst->opc) {
+        case 0: // movn
+            emit_mov_imm64(RAX, inst->sf ? ~operand : (uint32_t) ~operand);
+            emit_store_guest(RAX, inst->rd);
+            return true;
+        case 2: // movz
+            emit_mov_imm64(RAX, inst->sf ? operand : (uint32_t) operand);
+            emit_store_guest(RAX, inst->rd);
+            return true;
+        case 3: // movk
+            // leave 32-bit moves into the upper half to the interpreter's check
+            if (!inst->sf && hw > 1) return false;
+            emit_load_guest(RAX, inst->rd);
+            emit_mov_imm64(RCX, ~(0xFFFFULL << (hw * 16)));
+            emit_alu(ALU_AND, true, RAX, RCX);
+            emit_mov_imm64(RCX, operand);
+            emit_alu(ALU_OR, true, RAX, RCX);
+            if (!inst->sf) emit_mov(false, RAX, RAX);
+            emit_store_guest(RAX, inst->rd);
+            return true;
+        default:
+            return true;
+    }
+}
+
+static bool emit_dp_reg(const Instruction *inst) {
+    if (inst->dp_reg.m) {
+        // multiply: rd = ra +/- rn * rm
+        unsigned char ra = BITMASK(inst->dp_reg.operand, 0, 4);
+        emit_load_guest(RAX, inst->dp_reg.rn);
+        emit_load_guest(RCX, inst->dp_reg.rm);
+        emit_imul(RAX, RCX);
+        emit_load_guest(RDX, ra);
+        emit_alu(GET_BIT(inst->dp_reg.operand, 5) ? ALU_SUB : ALU_ADD, true, RDX, RAX);
+        if (!inst->sf) emit_mov(false, RDX, RDX);
+        emit_store_guest(RDX, inst->rd);
+        return true;
+    }
+
+    emit_shift_operand(inst);
+    emit_load_guest(RAX, inst->dp_reg.rn);
+    if (GET_BIT(inst->dp_reg.opr, 3)) {
+        emit_arith(inst, inst->rd);
+        return true;
+    }
+
+    static const int logical_operations[] = { ALU_AND, ALU_OR, ALU_XOR, ALU_AND };
+    emit_alu(logical_operations[inst->opc], inst->sf, RAX, RCX);
+    emit_store_guest(RAX, inst->rd);
+    if (inst->opc == 3) emit_pstate_flags(false, false);
+    return true;
+}
+
+static bool emit_sdt(const Instruction *inst, uint32_t address) {
+    bool load = inst->single_data_transfer.l;
+    unsigned char xn = inst->single_data_transfer.xn;
+    SDTOffset offset = inst->single_data_transfer.offset;
+    uint64_t next = (uint64_t) address + WORD_BYTES;
+
+    switch (inst->single_data_transfer.offset_type) {
+        case REGISTER_OFFSET:
+            emit_load_guest(RCX, xn);
+            emit_load_guest(RAX, offset.xm);
+            emit_alu(ALU_ADD, true, RCX, RAX);
+            emit_transfer(inst, load, next, -1);
+            return true;
+        case UNSIGNED_OFFSET:
+            emit_load_guest(RCX, xn);
+            emit_alu_imm(ALU_ADD, true, RCX, offset.imm12 * (inst->sf ? 8 : 4));
+            emit_transfer(inst, load, next, -1);
+            return true;
+        case PRE_INDEX_OFFSET:
+            // r12 survives the call, holding the written-back address
+            emit_load_guest(R12, xn);
+            emit_alu_imm(ALU_ADD, true, R12, offset.simm9);
+            emit_mov(true, RCX, R12);
+            emit_transfer(inst, load, next, R12);
+            return true;
+        case POST_INDEX_OFFSET:
+            emit_load_guest(R12, xn);
+            emit_mov(true, RCX, R12);
+            emit_alu_imm(ALU_ADD, true, R12, offset.simm9);
+            emit_transfer(inst, load, next, R12);
+            return true;
+    }
+    return false;
+}
+
+// Emits rax = 1 if the condition holds on pstate, and 0 otherwise.
+static void emit_condition(unsigned char cond) {
+    // eax = pstate; ecx = N != V; edx = Z
+    emit8(0x0F); emit8(0xB6);                  // movzx eax, byte [rbx + pstate]
+    emit_modrm_state(RAX, PSTATE_OFFSET);
+    emit_mov(false, RCX, RAX);
+    emit_shift_imm(SHIFT_SHR, false, RCX, neg_bit);
+    emit_mov(false, RDX, RAX);
+    emit_shift_imm(SHIFT_SHR, false, RDX, overflow_bit);
+    emit_alu(ALU_XOR, false, RCX, RDX);
+    emit_alu_imm(ALU_AND, false, RCX, 1);
+    emit_mov(false, RDX, RAX);
+    emit_shift_imm(SHIFT_SHR, false, RDX, zero_bit);
+    emit_alu_imm(ALU_AND, false, RDX, 1);
+
+    switch (cond) {
+        case 0:  emit_mov(false, RAX, RDX); break;                                     // eq: Z
+        case 1:  emit_mov(false, RAX, RDX); emit_alu_imm(ALU_XOR, false, RAX, 1); break; // ne: !Z
+        case 10: emit_mov(false, RAX, RCX); emit_alu_imm(ALU_XOR, false, RAX, 1); break; // ge: N == V
+        case 11: emit_mov(false, RAX, RCX); break;                                     // lt: N != V
+        case 12: emit_mov(false, RAX, RCX); emit_alu(ALU_OR, false, RAX, RDX);
+                 emit_alu_imm(ALU_XOR, false, RAX, 1); break;                          // gt: !Z && N == V
+        case 13: emit_mov(false, RAX, RCX); emit_alu(ALU_OR, false, RAX, RDX); break;  // le
+        case 14: emit_mov_imm32(RAX, 1); break;                                        // al
+        default: emit_mov_imm32(RAX, 0); break;
+    }
+}
+
+static bool emit_branch(const Instruction *inst, uint32_t address) {
+    switch (inst->branch.operand_type) {
+        case UNCOND_BRANCH:
+            emit_exit(branch_target(address, inst->branch.operand.uncond_branch.simm26));
+            return true;
+        case COND_BRANCH:
+            emit_condition(inst->branch.operand.cond_branch.cond);
+            // test eax, eax; pc = eax ? target : next
+            emit8(0x85); emit8(0xC0);
+            emit_mov_imm64(RCX, (uint64_t) address + WORD_BYTES);
+            emit_mov_imm64(RDX, branch_target(address, inst->branch.operand.cond_branch.simm19));
+            emit8(0x48); emit8(0x0F); emit8(0x45); emit8(0xCA); // cmovne rcx, rdx
+            emit_mov(true, RAX, RCX);
+            emit_exit_rax();
+            return true;
+        case REGISTER_BRANCH:
+            // pc = (uint32_t) (xn - 4) + 4, as branch() computes it
+            emit_load_guest(RAX, inst->branch.operand.register_branch.xn);
+            emit_alu_imm(ALU_SUB, false, RAX, WORD_BYTES);
+            emit_alu_imm(ALU_ADD, true, RAX, WORD_BYTES);
+            emit_exit_rax();
+            return true;
+    }
+    return false;
+}
+
+/*
+    Emits native code for one instruction.
+    Returns false (possibly after emitting partial code) if the
+    instruction is left to the interpreter.
+*/
+static bool emit_instruction(const Instruction *inst, uint32_t address) {
+    switch (inst->command_format) {
+        case DP_IMM:               return emit_dp_imm(inst);
+        case DP_REG:               return emit_dp_reg(inst);
+        case SINGLE_DATA_TRANSFER: return emit_sdt(inst, address);
+        case LOAD_LITERAL:
+            emit_mov_imm64(RCX, (uint64_t) address + (int64_t) inst->load_literal.simm19 * WORD_BYTES);
+            emit_transfer(inst, true, (uint64_t) address + WORD_BYTES, -1);
+            return true;
+        case BRANCH:               return emit_branch(inst, address);
+        case HALT:
+        case UNKNOWN:
+        default:                   return false;
+    }
+}
+
+/*
+    Compiles the block starting at block->start into the executable
+    buffer, ending it before the first instruction the backend does not
+    handle. Returns false if the first instruction cannot be compiled.
+*/
+static bool compile_block(Core *core, JitBlock *block) {
+    JitState *jit = core->jit;
+    unsigned char *code = jit->buffer + jit->buffer_used;
+    cursor = code;
+    cursor_limit = jit->buffer + JIT_BUFFER_SIZE;
+    emit_prologue();
+
+    uint64_t address = block->start;
+    int num_insts = 0;
+    while (1) {
+        if (num_insts == JIT_MAX_BLOCK_INSTS || address + WORD_BYTES > get_memory_size(core->emulator)) {
+            emit_exit(address);
+            break;
+        }
+        Instruction inst = decode(readmem32(core->emulator, address));
+        unsigned char *inst_start = cursor;
+        if (!emit_instruction(&inst, address)) {
+            if (num_insts == 0) return false;
+            // hand the rest of the block back to the interpreter
+            cursor = inst_start;
+            emit_exit(address);
+            break;
+        }
+        num_insts++;
+        address += WORD_BYTES;
+        if (inst.command_format == BRANCH) break;
+    }
+
+    if (cursor > cursor_limit) {
+        // the buffer is full: drop all compiled code and start again
+        uint32_t start = block->start;
+        jit_reset(jit);
+        *block = (JitBlock) { .start = start };
+        return compile_block(core, block);
+    }
+
+    jit->buffer_used = cursor - jit->buffer;
+    memcpy(&block->code, &code, sizeof(block->code));
+    block->end = address;
+    block->compiled = true;
+    mark_code(core->emulator, block->start, block->end - block->start);
+    return true;
+}
+
+// Finds the bit that a single flag occupies within the pstate byte.
+static int pstate_bit(ProcessorStateRegister pstate) {
+    unsigned char byte;
+    memcpy(&byte, &pstate, sizeof(byte));
+    for (int bit = 0; bit < 8; bit++) {
+        if (GET_BIT(byte, bit)) return bit;
+    }
+    return -1;
+}
+
+static bool backend_init(void) {
+    if (sizeof(ProcessorStateRegister) != 1) return false;
+    ProcessorStateRegister pstate;
+
+    memset(&pstate, 0, sizeof(pstate)); pstate.zero = 1;
+    zero_bit = pstate_bit(pstate);
+    memset(&pstate, 0, sizeof(pstate)); pstate.neg = 1;
+    neg_bit = pstate_bit(pstate);
+    memset(&pstate, 0, sizeof(pstate)); pstate.carry = 1;
+    carry_bit = pstate_bit(pstate);
+    memset(&pstate, 0, sizeof(pstate)); pstate.overflow = 1;
+    overflow_bit = pstate_bit(pstate);
+    return zero_bit >= 0 && neg_bit >= 0 && carry_bit >= 0 && overflow_bit >= 0;
+}
+
+#else
+
+// Other hosts have no backend, so every block is left to the interpreter.
+static bool compile_block(Core *core, JitBlock *block) {
+    return false;
+}
+
+static bool backend_init(void) {
+    return false;
+}
+
+#endif
+
+/*
+    Allocates the core's JIT cache and executable buffer on first use,
+    and prepares the backend. Returns false if compiled code cannot be run
+    on this host.
+*/
+static bool jit_init(Core *core) {
+    if (core->jit == NULL) {
+        core->jit = calloc(1, sizeof(JitState));
+        if (core->jit == NULL) {
+            fprintf(stderr, "run_jit: ran out of memory\n");
+            exit(1);
+        }
+    }
+    JitState *jit = core->jit;
+    if (!backend_init()) return false;
+    if (jit->buffer == NULL) {
+        void *buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED) return false;
+        jit->buffer = buffer;
+    }
+    return true;
+}
+
+/*
+    Counts an entry into the block starting at address, compiling it once
+    it has been entered JIT_THRESHOLD times.
+*/
+static void count_entry(Core *core, uint32_t address) {
+    JitBlock *block = &core->jit->cache[JIT_INDEX(address)];
+    if (block->start != address) {
+        *block = (JitBlock) { .start = address };
+    }
+    if (block->compiled || block->uncompilable || ++block->hits < JIT_THRESHOLD) return;
+
+    if (!compile_block(core, block)) {
+        block->end = (uint64_t) address + WORD_BYTES;
+        block->uncompilable = true;
+    }
+}
+
+/*
+    Runs the machine from the current program counter, interpreting
+    instructions and counting branch targets until they are hot enough
+    to compile. Compiled blocks are run natively.
+    Returns once the machine halts.
+*/
+void run_jit(Core *core) {
+    MachineState *machine_state = &core->machine_state;
+    bool enabled = jit_init(core);
+    if (!enabled) {
+        fprintf(stderr, "run_jit: no JIT backend for this host, interpreting instead\n");
+    }
+
+    while (!machine_state->halted) {
+        sync_core_code(core);
+        uint32_t pc = machine_state->program_counter.data;
+        const JitBlock *block = &core->jit->cache[JIT_INDEX(pc)];
+        if (block->compiled && block->start == pc) {
+            core->jit->running_block = block;
+            core->jit->running_block_stale = false;
+            // compiled code reads and writes pstate directly
+            read_pstate(machine_state);
+            block->code(core);
+            continue;
+        }
+
+        const Instruction *inst = icache_lookup(core);
+        bool is_branch = inst->command_format == BRANCH;
+        execute(core, inst);
+        increment_pc(machine_state);
+        if (enabled && is_branch) {
+            count_entry(core, machine_state->program_counter.data);
+        }
+    }
+}
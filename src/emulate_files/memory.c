@@ -1,99 +1,430 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include "../headers/memory.h"
+#include "../headers/block.h"
+#include "../headers/emulator.h"
+#include "../headers/icache.h"
+#include "../headers/instructions.h"
+#include "../headers/jit.h"
 
 #define BYTE_BITS 8
-#define WORD_BITS 32
 #define WORD_BYTES 4
 
-// Define a char[] representing the machine memory.
-// Data is stored in little-endian.
-static unsigned char memory[MEMORY_SIZE];
+#define PAGE_OFFSET(address) ((address) & (PAGE_SIZE - 1))
+// Number of pages covered by one second-level page table.
+#define TABLE_PAGES 512
+#define TABLE_BYTES ((uint64_t) TABLE_PAGES * PAGE_SIZE)
+
+// Granularity at which memory is marked as holding decoded code.
+#define CODE_LINE_BYTES 64
 
 /*
-    Clears memory, setting all values to 0.
+    A page of guest memory. Data is stored in little-endian.
+    bytes is either owned by the page or points into a copy-on-write
+    mapping of the loaded image.
+    Each bit of code_lines marks a CODE_LINE_BYTES line of the page from
+    which an instruction has been decoded. written is set once anything
+    is loaded or stored into the page. Both may be set by any core.
 */
-void initmem(void) {
-    memset(memory, 0, MEMORY_SIZE * sizeof(char));
+typedef struct {
+    unsigned char *bytes;
+    _Atomic uint64_t code_lines;
+    atomic_bool written;
+    bool mapped;
+} Page;
+
+struct page_table {
+    Page *_Atomic pages[TABLE_PAGES];
+};
+
+static const unsigned char zero_page[PAGE_SIZE];
+
+/*
+    Frees every page and the loaded image, leaving no memory allocated.
+*/
+void freemem(Emulator *emulator) {
+    Memory *memory = &emulator->memory;
+    for (uint64_t i = 0; i < memory->num_page_tables; i++) {
+        PageTable *table = memory->page_tables[i];
+        if (table == NULL) continue;
+        for (int j = 0; j < TABLE_PAGES; j++) {
+            Page *page = table->pages[j];
+            if (page != NULL && !page->mapped) free(page->bytes);
+            free(page);
+        }
+        free(table);
+    }
+    free(memory->page_tables);
+    memory->page_tables = NULL;
+    memory->num_page_tables = 0;
+
+    if (memory->image != NULL) {
+        munmap(memory->image, memory->image_size);
+        memory->image = NULL;
+        memory->image_size = 0;
+    }
 }
 
 /*
-    Loads an array into memory using memcpy.
-    Used to load instructions to memory.
+    Takes the size of the address space in bytes, which must be a
+    multiple of PAGE_SIZE no larger than MAX_MEMORY_SIZE.
+    Clears memory, setting all values to 0. No pages are allocated
+    until they are written to.
 */
-void loadtomem(void *arr, uint32_t numbytes) {
-    if (numbytes > MEMORY_SIZE) {
-        fprintf(stderr, "loadtomem: number of bytes exceeds memory.");
+void initmem(Emulator *emulator, uint64_t size) {
+    Memory *memory = &emulator->memory;
+    if (size == 0 || size > MAX_MEMORY_SIZE || PAGE_OFFSET(size) != 0) {
+        fprintf(stderr, "initmem: invalid memory size %" PRIu64 ".\n", size);
+        exit(1);
+    }
+    freemem(emulator);
+    memory->size = size;
+    memory->num_page_tables = (size + TABLE_BYTES - 1) / TABLE_BYTES;
+    memory->page_tables = calloc(memory->num_page_tables, sizeof(*memory->page_tables));
+    if (memory->page_tables == NULL) {
+        fprintf(stderr, "initmem: ran out of memory.\n");
+        exit(1);
     }
-    memcpy(memory, arr, numbytes);
 }
 
 /*
-    Takes a 21-bit address as uint32_t.
-    Returns a pointer to the byte at that address as unsigned char.
+    Returns the size of the address space in bytes.
 */
-static unsigned char *fetchbyte(uint32_t address) {
-    return &memory[address];
+uint64_t get_memory_size(const Emulator *emulator) {
+    return emulator->memory.size;
 }
 
 /*
-    Takes a 21-bit address as uint32_t.
-    Returns 32 bits (4 bytes) of data at that address as uint32_t.
+    Takes an address within memory.
+    Returns the page holding it, or NULL if the page was never touched.
 */
-uint32_t readmem32(uint32_t address) {
-    // Fetch pointer to the first byte.
-    unsigned char *startbyte = fetchbyte(address);
-    // Define uint32_t to return.
-    uint32_t data = 0;
+static Page *find_page(const Memory *memory, uint64_t address) {
+    PageTable *table = memory->page_tables[address / TABLE_BYTES];
+    if (table == NULL) return NULL;
+    return table->pages[(address / PAGE_SIZE) % TABLE_PAGES];
+}
+
+/*
+    Takes an address within memory and the bytes to back its page with,
+    or NULL to allocate zeroed bytes for it.
+    Returns the page holding the address, creating it if needed.
+*/
+static Page *add_page(Memory *memory, uint64_t address, unsigned char *bytes) {
+    Page *existing = find_page(memory, address);
+    if (existing != NULL) return existing;
 
-    // Fetch each byte, shifting them accordingly.
-    for (int i = 0; i < WORD_BYTES; i++) {
-        data |= startbyte[i] << (BYTE_BITS * i);
+    // Another core may be creating the same page, so look again under the lock.
+    pthread_mutex_lock(&memory->lock);
+    PageTable *_Atomic *table = &memory->page_tables[address / TABLE_BYTES];
+    if (*table == NULL) {
+        PageTable *new_table = calloc(1, sizeof(PageTable));
+        if (new_table == NULL) {
+            fprintf(stderr, "add_page: ran out of memory.\n");
+            exit(1);
+        }
+        *table = new_table;
+    }
+    Page *_Atomic *page = &(*table)->pages[(address / PAGE_SIZE) % TABLE_PAGES];
+    if (*page == NULL) {
+        Page *new_page = calloc(1, sizeof(Page));
+        unsigned char *new_bytes = (bytes != NULL) ? bytes : calloc(PAGE_SIZE, 1);
+        if (new_page == NULL || new_bytes == NULL) {
+            fprintf(stderr, "add_page: ran out of memory.\n");
+            exit(1);
+        }
+        new_page->bytes = new_bytes;
+        new_page->mapped = (bytes != NULL);
+        *page = new_page;
     }
+    Page *result = *page;
+    pthread_mutex_unlock(&memory->lock);
+    return result;
+}
 
-    return data;
+/*
+    Takes an address within memory.
+    Returns the page holding it, allocating a zeroed page if needed.
+*/
+static Page *touch_page(Memory *memory, uint64_t address) {
+    return add_page(memory, address, NULL);
 }
 
 /*
-    Takes an address as uint32_t.
-    Returns 64 bits (8 bytes) of data at that address as uint64_t.
+    Takes an address and a number of bytes from that address.
+    Marks the range as holding code, so that writes to it invalidate
+    any cached decoding of it.
 */
-uint64_t readmem64(uint32_t address) {
-    // Define uint64_t to return.
-    uint64_t data = 0;
+void mark_code(Emulator *emulator, uint32_t address, uint64_t numbytes) {
+    Memory *memory = &emulator->memory;
+    uint64_t end = (uint64_t) address + numbytes;
+    if (end > memory->size) end = memory->size;
+    for (uint64_t line = address / CODE_LINE_BYTES; line * CODE_LINE_BYTES < end; line++) {
+        uint64_t line_address = line * CODE_LINE_BYTES;
+        Page *page = touch_page(memory, line_address);
+        uint64_t line_bit = FILL_BIT(PAGE_OFFSET(line_address) / CODE_LINE_BYTES);
+        if (!(page->code_lines & line_bit)) page->code_lines |= line_bit;
+    }
+}
 
-    // Fetch each data from memory using readmem32 twice.
-    for (int i = 0; i < (2 * WORD_BYTES); i += WORD_BYTES) {
-        data <<= WORD_BITS;
-        data |= readmem32(address + WORD_BYTES - i);
+/*
+    Takes an address and a number of bytes from that address.
+    Returns whether any of the range has been marked as holding code.
+*/
+static bool holds_code(const Memory *memory, uint64_t address, uint64_t numbytes) {
+    uint64_t end = address + numbytes;
+    for (uint64_t line = address / CODE_LINE_BYTES; line * CODE_LINE_BYTES < end; line++) {
+        uint64_t line_address = line * CODE_LINE_BYTES;
+        const Page *page = find_page(memory, line_address);
+        if (page != NULL && GET_BIT(page->code_lines, PAGE_OFFSET(line_address) / CODE_LINE_BYTES)) return true;
     }
+    return false;
+}
 
-    return data;
+/*
+    Copies numbytes bytes of memory starting at address into dest.
+*/
+static void copyfrommem(const Memory *memory, void *dest, uint64_t address, uint64_t numbytes) {
+    unsigned char *bytes = dest;
+    while (numbytes > 0) {
+        uint64_t offset = PAGE_OFFSET(address);
+        uint64_t chunk = PAGE_SIZE - offset < numbytes ? PAGE_SIZE - offset : numbytes;
+        const Page *page = find_page(memory, address);
+        memcpy(bytes, (page != NULL ? page->bytes : zero_page) + offset, chunk);
+        bytes += chunk;
+        address += chunk;
+        numbytes -= chunk;
+    }
 }
 
 /*
-    Takes an address and data 32 bits of data as uint32_t.
-    Writes 32 bits (4 bytes) at specified address.
+    Copies numbytes bytes from src into memory starting at address,
+    allocating any pages written to.
 */
-void writemem32(uint32_t address, uint32_t data) {
-    // Fetch pointer to the first byte.
-    unsigned char *startbyte = fetchbyte(address);
+static void copytomem(Memory *memory, uint64_t address, const void *src, uint64_t numbytes) {
+    const unsigned char *bytes = src;
+    while (numbytes > 0) {
+        uint64_t offset = PAGE_OFFSET(address);
+        uint64_t chunk = PAGE_SIZE - offset < numbytes ? PAGE_SIZE - offset : numbytes;
+        Page *page = touch_page(memory, address);
+        memcpy(page->bytes + offset, bytes, chunk);
+        if (!page->written) page->written = true;
+        bytes += chunk;
+        address += chunk;
+        numbytes -= chunk;
+    }
+}
 
-    // Write to memory byte-by-byte.
-    for (int i = 0; i < WORD_BYTES; i++) {
+/*
+    Takes a function to call on each page that has been loaded or written,
+    in address order, and a context to pass it. Pages that were never
+    written hold only zeroes.
+*/
+void visit_written_pages(const Emulator *emulator, PageVisitor visit, void *context) {
+    const Memory *memory = &emulator->memory;
+    for (uint64_t i = 0; i < memory->num_page_tables; i++) {
+        const PageTable *table = memory->page_tables[i];
+        if (table == NULL) continue;
+        for (int j = 0; j < TABLE_PAGES; j++) {
+            const Page *page = table->pages[j];
+            if (page != NULL && page->written) {
+                visit(i * TABLE_BYTES + (uint64_t) j * PAGE_SIZE, page->bytes, context);
+            }
+        }
+    }
+}
+
+/*
+    Takes a private, writable mapping of size bytes, such as a MAP_PRIVATE
+    mapping of a file, for pages to be backed by with mappage.
+    Memory takes ownership of the mapping and unmaps it in freemem.
+*/
+void mapimage(Emulator *emulator, void *image, uint64_t size) {
+    Memory *memory = &emulator->memory;
+    if (memory->image != NULL) {
+        fprintf(stderr, "mapimage: an image is already loaded.\n");
+        exit(1);
+    }
+    memory->image = image;
+    memory->image_size = size;
+}
+
+/*
+    Takes the page-aligned address of a page that has not been touched, and
+    PAGE_SIZE bytes within the image to back it with. The page is backed by
+    the image itself, so nothing is copied up front and the host copies the
+    page only when the guest first writes to it.
+*/
+void mappage(Emulator *emulator, uint64_t address, unsigned char *bytes) {
+    Memory *memory = &emulator->memory;
+    if (PAGE_OFFSET(address) != 0 || address >= memory->size || find_page(memory, address) != NULL) {
+        fprintf(stderr, "mappage: can't map a page at 0x%" PRIx64 ".\n", address);
+        exit(1);
+    }
+    Page *page = add_page(memory, address, bytes);
+    page->written = true;
+}
+
+/*
+    Takes a private, writable mapping of numbytes bytes, such as a
+    MAP_PRIVATE mapping of the input file, and places it at address 0.
+*/
+void maptomem(Emulator *emulator, void *mapping, uint64_t numbytes) {
+    if (numbytes > emulator->memory.size) {
+        fprintf(stderr, "maptomem: number of bytes exceeds memory.\n");
+        exit(1);
+    }
+    mapimage(emulator, mapping, numbytes);
+    for (uint64_t address = 0; address < numbytes; address += PAGE_SIZE) {
+        mappage(emulator, address, (unsigned char *) mapping + address);
+    }
+}
+
+/*
+    Loads an array into memory using memcpy.
+    Used to load instructions to memory.
+*/
+void loadtomem(Emulator *emulator, void *arr, uint32_t numbytes) {
+    if (numbytes > emulator->memory.size) {
+        fprintf(stderr, "loadtomem: number of bytes exceeds memory.\n");
+        exit(1);
+    }
+    copytomem(&emulator->memory, 0, arr, numbytes);
+}
+
+/*
+    Takes the name of the accessing function, an address and a number of bytes.
+    Exits with an error if the access would fall outside memory.
+*/
+static void check_bounds(const Memory *memory, const char *caller, uint64_t address, uint32_t numbytes) {
+    if (address > memory->size - numbytes) {
+        fprintf(stderr, "%s: address 0x%" PRIx64 " is out of bounds.\n", caller, address);
+        exit(1);
+    }
+}
+
+/*
+    Little-endian hosts copy words straight in and out of memory, and
+    big-endian hosts with byte swap builtins swap them after copying.
+    Any other host assembles words a byte at a time.
+*/
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LITTLE_ENDIAN_32(x) (x)
+#define LITTLE_ENDIAN_64(x) (x)
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LITTLE_ENDIAN_32(x) __builtin_bswap32(x)
+#define LITTLE_ENDIAN_64(x) __builtin_bswap64(x)
+#else
+
+static uint64_t loadbytes(const unsigned char *startbyte, int numbytes) {
+    uint64_t data = 0;
+    for (int i = 0; i < numbytes; i++) {
+        data |= (uint64_t) startbyte[i] << (BYTE_BITS * i);
+    }
+    return data;
+}
+
+static void storebytes(unsigned char *startbyte, uint64_t data, int numbytes) {
+    for (int i = 0; i < numbytes; i++) {
         startbyte[i] = data;
         data >>= BYTE_BITS;
     }
 }
 
+#endif
+
 /*
-    Takes an address as uint32_t andi 64 bits of data as uint64_t.
-    Writes 64 bits (8 bytes) at specified address.
+    Takes the core that wrote to memory, an address and a number of bytes
+    written from that address. Drops the core's predecoded, translated or
+    compiled copies of the overwritten bytes, and tells every other core to
+    drop its cached code before it runs its next instruction or block.
 */
-void writemem64(uint32_t address, uint64_t data) { 
-    // Write to memory using writemem32 twice.
-    for (int i = 0; i < (2 * WORD_BYTES); i += WORD_BYTES) {
-        writemem32(address + i, data);
-        data >>= WORD_BITS;
+static void invalidate_code(Core *core, uint64_t address, uint32_t numbytes) {
+    Emulator *emulator = core->emulator;
+    if (holds_code(&emulator->memory, address, numbytes)) {
+        icache_invalidate(core, address, numbytes);
+        block_invalidate(core, address, numbytes);
+        jit_invalidate(core, address, numbytes);
+        for (int i = 0; i < emulator->num_cores; i++) {
+            if (&emulator->cores[i] != core) {
+                atomic_store_explicit(&emulator->cores[i].code_changed, true, memory_order_release);
+            }
+        }
     }
 }
+
+/*
+    Takes an address within memory.
+    Returns 32 bits (4 bytes) of data at that address as uint32_t.
+*/
+uint32_t readmem32(Emulator *emulator, uint64_t address) {
+    const Memory *memory = &emulator->memory;
+    check_bounds(memory, "readmem32", address, WORD_BYTES);
+#ifdef LITTLE_ENDIAN_32
+    uint32_t data;
+    copyfrommem(memory, &data, address, sizeof(data));
+    return LITTLE_ENDIAN_32(data);
+#else
+    unsigned char bytes[WORD_BYTES];
+    copyfrommem(memory, bytes, address, WORD_BYTES);
+    return loadbytes(bytes, WORD_BYTES);
+#endif
+}
+
+/*
+    Takes an address within memory.
+    Returns 64 bits (8 bytes) of data at that address as uint64_t.
+*/
+uint64_t readmem64(Emulator *emulator, uint64_t address) {
+    const Memory *memory = &emulator->memory;
+    check_bounds(memory, "readmem64", address, 2 * WORD_BYTES);
+#ifdef LITTLE_ENDIAN_64
+    uint64_t data;
+    copyfrommem(memory, &data, address, sizeof(data));
+    return LITTLE_ENDIAN_64(data);
+#else
+    unsigned char bytes[2 * WORD_BYTES];
+    copyfrommem(memory, bytes, address, 2 * WORD_BYTES);
+    return loadbytes(bytes, 2 * WORD_BYTES);
+#endif
+}
+
+/*
+    Takes an address within memory and 32 bits of data as uint32_t.
+    Writes 32 bits (4 bytes) at specified address.
+*/
+void writemem32(Core *core, uint64_t address, uint32_t data) {
+    Memory *memory = &core->emulator->memory;
+    check_bounds(memory, "writemem32", address, WORD_BYTES);
+#ifdef LITTLE_ENDIAN_32
+    data = LITTLE_ENDIAN_32(data);
+    copytomem(memory, address, &data, sizeof(data));
+#else
+    unsigned char bytes[WORD_BYTES];
+    storebytes(bytes, data, WORD_BYTES);
+    copytomem(memory, address, bytes, WORD_BYTES);
+#endif
+    invalidate_code(core, address, WORD_BYTES);
+}
+
+/*
+    Takes an address within memory and 64 bits of data as uint64_t.
+    Writes 64 bits (8 bytes) at specified address.
+*/
+void writemem64(Core *core, uint64_t address, uint64_t data) {
+    Memory *memory = &core->emulator->memory;
+    check_bounds(memory, "writemem64", address, 2 * WORD_BYTES);
+#ifdef LITTLE_ENDIAN_64
+    data = LITTLE_ENDIAN_64(data);
+    copytomem(memory, address, &data, sizeof(data));
+#else
+    unsigned char bytes[2 * WORD_BYTES];
+    storebytes(bytes, data, 2 * WORD_BYTES);
+    copytomem(memory, address, bytes, 2 * WORD_BYTES);
+#endif
+    invalidate_code(core, address, 2 * WORD_BYTES);
+}
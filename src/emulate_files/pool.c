@@ -0,0 +1,147 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../headers/pool.h"
+
+/*
+    The tasks still owned by a worker, as the range [top, bottom).
+    The owner takes tasks from the top and thieves take them from the
+    bottom, so a worker runs its tasks in order and thieves take the
+    tasks it would have reached last.
+*/
+typedef struct {
+    pthread_mutex_t lock;
+    size_t top;
+    size_t bottom;
+} TaskQueue;
+
+typedef struct pool Pool;
+
+typedef struct {
+    Pool *pool;
+    int index;
+    pthread_t thread;
+    TaskQueue queue;
+} Worker;
+
+struct pool {
+    PoolTask task;
+    void *context;
+    int num_workers;
+    Worker *workers;
+};
+
+/*
+    Returns the number of host cores available, and at least 1.
+*/
+int host_cores(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? cores : 1;
+}
+
+/*
+    Takes the next task from the top of the worker's own queue.
+    Returns false if the queue is empty.
+*/
+static bool pop_task(Worker *worker, size_t *task) {
+    TaskQueue *queue = &worker->queue;
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->top < queue->bottom;
+    if (found) {
+        *task = queue->top;
+        queue->top++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+/*
+    Moves the bottom half of the first non-empty queue found after the
+    worker's own into the worker's queue. Returns false if every other
+    queue was empty, in which case the worker can stop: tasks are never
+    added once the pool has started, so any left belong to a running worker.
+*/
+static bool steal_tasks(Worker *worker) {
+    Pool *pool = worker->pool;
+    for (int i = 1; i < pool->num_workers; i++) {
+        TaskQueue *victim = &pool->workers[(worker->index + i) % pool->num_workers].queue;
+        pthread_mutex_lock(&victim->lock);
+        size_t remaining = victim->bottom - victim->top;
+        size_t stolen = (remaining + 1) / 2;
+        size_t bottom = victim->bottom;
+        victim->bottom -= stolen;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (stolen > 0) {
+            pthread_mutex_lock(&worker->queue.lock);
+            worker->queue.top = bottom - stolen;
+            worker->queue.bottom = bottom;
+            pthread_mutex_unlock(&worker->queue.lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    Runs tasks from the worker's own queue, stealing from the others
+    whenever it runs dry, until no tasks are left.
+*/
+static void *run_worker(void *arg) {
+    Worker *worker = arg;
+    Pool *pool = worker->pool;
+    do {
+        size_t task;
+        while (pop_task(worker, &task)) {
+            pool->task(pool->context, task, worker->index);
+        }
+    } while (steal_tasks(worker));
+    return NULL;
+}
+
+/*
+    Runs tasks 0 to num_tasks - 1 across num_workers threads, one of which
+    is the calling thread, and returns once every task has finished.
+    Each worker starts with an equal share of the tasks and steals from the
+    others once its own share is done, so uneven tasks still keep every
+    worker busy.
+*/
+void run_pool(size_t num_tasks, int num_workers, PoolTask task, void *context) {
+    if (num_workers < 1) {
+        num_workers = 1;
+    }
+    Pool pool = { .task = task, .context = context, .num_workers = num_workers };
+    pool.workers = calloc(num_workers, sizeof(Worker));
+    if (pool.workers == NULL) {
+        fprintf(stderr, "run_pool: ran out of memory\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        Worker *worker = &pool.workers[i];
+        worker->pool = &pool;
+        worker->index = i;
+        worker->queue.top = num_tasks * i / num_workers;
+        worker->queue.bottom = num_tasks * (i + 1) / num_workers;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+    }
+
+    // Worker 0 runs on the calling thread.
+    for (int i = 1; i < num_workers; i++) {
+        if (pthread_create(&pool.workers[i].thread, NULL, run_worker, &pool.workers[i]) != 0) {
+            fprintf(stderr, "run_pool: can't start worker %d\n", i);
+            exit(1);
+        }
+    }
+    run_worker(&pool.workers[0]);
+    for (int i = 1; i < num_workers; i++) {
+        pthread_join(pool.workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        pthread_mutex_destroy(&pool.workers[i].queue.lock);
+    }
+    free(pool.workers);
+}
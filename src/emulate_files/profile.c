@@ -0,0 +1,313 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../headers/profile.h"
+
+// Kinds of instruction recorded for a PC.
+#define PROFILE_COND_BRANCH 0x1
+
+// Number of counter slots allocated for the first PC recorded.
+#define INITIAL_SLOTS 1024
+
+// A label and the address it marks.
+typedef struct {
+    uint32_t address;
+    char *name;
+} Symbol;
+
+/*
+    Counters of a profiled run. Every counter array is indexed by PC / 4
+    and grows to cover the highest PC run, so recording an instruction
+    costs a few array increments.
+*/
+struct profile {
+    size_t num_slots;
+    // number of times the instruction at each PC was run
+    uint64_t *executions;
+    // number of times a basic block was entered at each PC
+    uint64_t *block_entries;
+    // number of instructions run in the blocks entered at each PC
+    uint64_t *block_instructions;
+    // number of times the conditional branch at each PC was taken
+    uint64_t *taken;
+    // PROFILE_* kinds of the instruction at each PC
+    unsigned char *kinds;
+    int num_cores;
+    // slot of the block each core is running, and whether its next
+    // instruction starts a new block
+    size_t *current_block;
+    bool *block_start;
+    // labels from the assembler, sorted by address
+    Symbol *symbols;
+    size_t num_symbols;
+};
+
+// An entry of a table of the report, ranked by count.
+typedef struct {
+    uint64_t count;
+    size_t slot;
+} Ranked;
+
+static void *profile_alloc(void *pointer, size_t size) {
+    pointer = realloc(pointer, size);
+    if (pointer == NULL) {
+        fprintf(stderr, "profile: ran out of memory\n");
+        exit(1);
+    }
+    return pointer;
+}
+
+/*
+    Takes the number of cores that will be run.
+    Returns an empty profile.
+*/
+Profile *profile_new(int num_cores) {
+    Profile *profile = calloc(1, sizeof(Profile));
+    if (profile == NULL) {
+        fprintf(stderr, "profile: ran out of memory\n");
+        exit(1);
+    }
+    profile->num_cores = num_cores;
+    profile->current_block = profile_alloc(NULL, num_cores * sizeof(size_t));
+    profile->block_start = profile_alloc(NULL, num_cores * sizeof(bool));
+    for (int i = 0; i < num_cores; i++) {
+        profile->current_block[i] = 0;
+        profile->block_start[i] = true;
+    }
+    return profile;
+}
+
+void profile_free(Profile *profile) {
+    if (profile == NULL) {
+        return;
+    }
+    free(profile->executions);
+    free(profile->block_entries);
+    free(profile->block_instructions);
+    free(profile->taken);
+    free(profile->kinds);
+    free(profile->current_block);
+    free(profile->block_start);
+    for (size_t i = 0; i < profile->num_symbols; i++) {
+        free(profile->symbols[i].name);
+    }
+    free(profile->symbols);
+    free(profile);
+}
+
+/*
+    Grows a counter array from old_slots to new_slots entries of size
+    bytes each, zeroing the new entries.
+*/
+static void *grow_counters(void *counters, size_t old_slots, size_t new_slots, size_t size) {
+    counters = profile_alloc(counters, new_slots * size);
+    memset((char *) counters + old_slots * size, 0, (new_slots - old_slots) * size);
+    return counters;
+}
+
+/*
+    Grows every counter array so that it covers slot.
+*/
+static void grow_profile(Profile *profile, size_t slot) {
+    size_t old_slots = profile->num_slots;
+    size_t new_slots = old_slots == 0 ? INITIAL_SLOTS : old_slots;
+    while (new_slots <= slot) {
+        new_slots *= 2;
+    }
+    profile->executions = grow_counters(profile->executions, old_slots, new_slots, sizeof(uint64_t));
+    profile->block_entries = grow_counters(profile->block_entries, old_slots, new_slots, sizeof(uint64_t));
+    profile->block_instructions = grow_counters(profile->block_instructions, old_slots, new_slots, sizeof(uint64_t));
+    profile->taken = grow_counters(profile->taken, old_slots, new_slots, sizeof(uint64_t));
+    profile->kinds = grow_counters(profile->kinds, old_slots, new_slots, sizeof(unsigned char));
+    profile->num_slots = new_slots;
+}
+
+/*
+    Records that core ran inst from address pc, where taken tells whether
+    a conditional branch's condition held. A branch of any kind ends the
+    core's basic block.
+*/
+void profile_record(Profile *profile, int core, uint32_t pc, const Instruction *inst, bool taken) {
+    size_t slot = pc / 4;
+    if (slot >= profile->num_slots) {
+        grow_profile(profile, slot);
+    }
+    profile->executions[slot]++;
+
+    if (profile->block_start[core]) {
+        profile->current_block[core] = slot;
+        profile->block_entries[slot]++;
+    }
+    profile->block_instructions[profile->current_block[core]]++;
+
+    bool branch = inst->command_format == BRANCH;
+    profile->block_start[core] = branch;
+    if (branch && inst->branch.operand_type == COND_BRANCH) {
+        profile->kinds[slot] |= PROFILE_COND_BRANCH;
+        if (taken) {
+            profile->taken[slot]++;
+        }
+    }
+}
+
+static int compare_symbols(const void *a, const void *b) {
+    uint32_t x = ((const Symbol *) a)->address;
+    uint32_t y = ((const Symbol *) b)->address;
+    return x < y ? -1 : x > y;
+}
+
+/*
+    Takes a symbol file written by the assembler, holding a hex address
+    and a label on each line. Adds its labels to the profile so that the
+    report names the code it lists. Returns false if the file can't be read.
+*/
+bool profile_load_symbols(Profile *profile, const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "profile_load_symbols: can't open %s, errno %d\n", filename, errno);
+        return false;
+    }
+
+    size_t capacity = profile->num_symbols;
+    char *line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, file) != -1) {
+        char *end;
+        unsigned long address = strtoul(line, &end, 16);
+        char *name = strtok(end, " \t\r\n");
+        if (end == line || name == NULL) continue;
+
+        if (profile->num_symbols == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            profile->symbols = profile_alloc(profile->symbols, capacity * sizeof(Symbol));
+        }
+        Symbol *symbol = &profile->symbols[profile->num_symbols++];
+        symbol->address = address;
+        symbol->name = strdup(name);
+        if (symbol->name == NULL) {
+            fprintf(stderr, "profile: ran out of memory\n");
+            exit(1);
+        }
+    }
+    free(line);
+    fclose(file);
+
+    qsort(profile->symbols, profile->num_symbols, sizeof(Symbol), compare_symbols);
+    return true;
+}
+
+/*
+    Writes the label at or below address, and the offset from it, into
+    location. Leaves location empty if no label comes before address.
+*/
+static void format_location(const Profile *profile, uint32_t address, char *location, size_t size) {
+    // binary search for the last symbol at or below address
+    size_t low = 0;
+    size_t high = profile->num_symbols;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (profile->symbols[mid].address <= address) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0) {
+        location[0] = '\0';
+        return;
+    }
+    const Symbol *symbol = &profile->symbols[low - 1];
+    if (symbol->address == address) {
+        snprintf(location, size, "%s", symbol->name);
+    } else {
+        snprintf(location, size, "%s+0x%" PRIx32, symbol->name, address - symbol->address);
+    }
+}
+
+static int compare_ranked(const void *a, const void *b) {
+    const Ranked *x = a;
+    const Ranked *y = b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return x->slot < y->slot ? -1 : x->slot > y->slot;
+}
+
+/*
+    Takes a counter array. Returns the slots with a non-zero count,
+    highest count first, setting num_ranked to their number.
+*/
+static Ranked *rank(const Profile *profile, const uint64_t *counters, size_t *num_ranked) {
+    Ranked *ranked = profile_alloc(NULL, (profile->num_slots + 1) * sizeof(Ranked));
+    *num_ranked = 0;
+    for (size_t slot = 0; slot < profile->num_slots; slot++) {
+        if (counters[slot] != 0) {
+            ranked[(*num_ranked)++] = (Ranked) { counters[slot], slot };
+        }
+    }
+    qsort(ranked, *num_ranked, sizeof(Ranked), compare_ranked);
+    return ranked;
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole == 0 ? 0.0 : 100.0 * part / whole;
+}
+
+/*
+    Writes a report of the hottest instructions, basic blocks and
+    conditional branches of the run into file.
+*/
+void profile_report(Profile *profile, FILE *file) {
+    uint64_t total = 0;
+    for (size_t slot = 0; slot < profile->num_slots; slot++) {
+        total += profile->executions[slot];
+    }
+    fprintf(file, "Profile: %" PRIu64 " instructions run\n", total);
+
+    char location[64];
+    size_t num_ranked;
+    Ranked *ranked = rank(profile, profile->executions, &num_ranked);
+    fprintf(file, "\nHottest instructions:\n");
+    fprintf(file, "%20s %7s  %-8s  %s\n", "count", "%", "address", "location");
+    for (size_t i = 0; i < num_ranked && i < PROFILE_REPORT_ENTRIES; i++) {
+        uint32_t address = ranked[i].slot * 4;
+        format_location(profile, address, location, sizeof(location));
+        fprintf(file, "%20" PRIu64 " %6.2f%%  %08" PRIx32 "  %s\n",
+                ranked[i].count, percent(ranked[i].count, total), address, location);
+    }
+    free(ranked);
+
+    ranked = rank(profile, profile->block_instructions, &num_ranked);
+    fprintf(file, "\nHottest basic blocks:\n");
+    fprintf(file, "%20s %7s %16s %8s  %-8s  %s\n", "instructions", "%", "entries", "length", "address", "location");
+    for (size_t i = 0; i < num_ranked && i < PROFILE_REPORT_ENTRIES; i++) {
+        uint32_t address = ranked[i].slot * 4;
+        uint64_t entries = profile->block_entries[ranked[i].slot];
+        format_location(profile, address, location, sizeof(location));
+        fprintf(file, "%20" PRIu64 " %6.2f%% %16" PRIu64 " %8.1f  %08" PRIx32 "  %s\n",
+                ranked[i].count, percent(ranked[i].count, total), entries,
+                (double) ranked[i].count / entries, address, location);
+    }
+    free(ranked);
+
+    // rank the conditional branches alone by how often they were run
+    uint64_t *branches = profile_alloc(NULL, (profile->num_slots + 1) * sizeof(uint64_t));
+    for (size_t slot = 0; slot < profile->num_slots; slot++) {
+        branches[slot] = profile->kinds[slot] & PROFILE_COND_BRANCH ? profile->executions[slot] : 0;
+    }
+    ranked = rank(profile, branches, &num_ranked);
+    fprintf(file, "\nConditional branches:\n");
+    fprintf(file, "%20s %16s %16s %7s  %-8s  %s\n", "executed", "taken", "not taken", "taken", "address", "location");
+    for (size_t i = 0; i < num_ranked && i < PROFILE_REPORT_ENTRIES; i++) {
+        uint32_t address = ranked[i].slot * 4;
+        uint64_t taken = profile->taken[ranked[i].slot];
+        format_location(profile, address, location, sizeof(location));
+        fprintf(file, "%20" PRIu64 " %16" PRIu64 " %16" PRIu64 " %6.2f%%  %08" PRIx32 "  %s\n",
+                ranked[i].count, taken, ranked[i].count - taken, percent(taken, ranked[i].count),
+                address, location);
+    }
+    free(ranked);
+    free(branches);
+}
@@ -1,54 +1,62 @@
 #include "../headers/registers.h"
+#include "../headers/instructions.h"
 #include <assert.h>
 
-static MachineState machine_state;
-
-void init_machine_state(void) {
-    // Creating a pointer to the machine state to alter the global var
-    MachineState *ms_pointer = &machine_state;
-
+/*
+    A function that resets the given machine state to its state at
+    power on: all registers zero and only the zero flag set
+*/
+void init_machine_state(MachineState *machine_state) {
     // Initialising the general registers
     for (int i = 0; i < NUM_GENERAL_REGISTERS; i++) {
-        ms_pointer->general_registers[i].data = 0;
-        ms_pointer->general_registers[i].writable = 1;
+        machine_state->general_registers[i].data = 0;
+        machine_state->general_registers[i].writable = 1;
     }
 
     // Initialising the special registers
-    ms_pointer->zero_register.data = 0;
-    ms_pointer->zero_register.writable = 0;
+    machine_state->zero_register.data = 0;
+    machine_state->zero_register.writable = 0;
 
-    ms_pointer->program_counter.data = 0;
-    ms_pointer->program_counter.writable = 1;
+    machine_state->program_counter.data = 0;
+    machine_state->program_counter.writable = 1;
 
-    ms_pointer->pstate.zero = 1;
-    ms_pointer->pstate.neg = 0;
-    ms_pointer->pstate.carry = 0;
-    ms_pointer->pstate.overflow = 0;
+    machine_state->pstate.zero = 1;
+    machine_state->pstate.neg = 0;
+    machine_state->pstate.carry = 0;
+    machine_state->pstate.overflow = 0;
+    machine_state->lazy_flags.operation = FLAGS_SETTLED;
+    machine_state->halted = false;
 }
 
 /*
-    A function that returns a copy of the machine_state (meant to be
-    read-only)
+    A function that reads a specific general register given
+    the required index
+    Reads the zero register when the index is NUM_GENERAL_REGISTERS
 */
-MachineState read_machine_state(void) {
-    return machine_state;
-}
+uint64_t read_general_registers(const MachineState *machine_state, int index) {
+    // Check that the index refers to an existing general register
+    assert(index <= NUM_GENERAL_REGISTERS);
+    assert(index >= 0);
 
+    if (index == NUM_GENERAL_REGISTERS) {
+        return machine_state->zero_register.data;
+    }
+    return machine_state->general_registers[index].data;
+}
 
 /*
     A function that writes to a specific general register given
     the required index, and the value that needs to be written
     Is a no-op when the index refers to the zero register
 */
-void write_general_registers(int index, uint64_t value) {
+void write_general_registers(MachineState *machine_state, int index, uint64_t value) {
     // Check that the index refers to an existing general register
     assert(index <= NUM_GENERAL_REGISTERS);
     assert(index >= 0);
 
     // If it's not the zero register, find register and write
     if (index != NUM_GENERAL_REGISTERS) {
-        MachineState *ms_pointer = &machine_state;
-        ms_pointer->general_registers[index].data = value;
+        machine_state->general_registers[index].data = value;
     }
 }
 
@@ -56,37 +64,96 @@ void write_general_registers(int index, uint64_t value) {
     A function that writes to the program counter a specific value,
     the logic of what that might be is  dealt with separately
 */
-void write_program_counter(uint32_t address) {
-    MachineState *ms_pointer = &machine_state;
-    ms_pointer->program_counter.data = address;
+void write_program_counter(MachineState *machine_state, uint32_t address) {
+    machine_state->program_counter.data = address;
 }
 
-void increment_pc(void) {
-    MachineState *ms_pointer = &machine_state;
-    write_program_counter((ms_pointer->program_counter.data) + 4);
+// A halted core stays at its HALT instruction.
+void increment_pc(MachineState *machine_state) {
+    if (!machine_state->halted) {
+        write_program_counter(machine_state, (machine_state->program_counter.data) + 4);
+    }
 }
 
 /*
     A function that sets pstate flags in the machine state, given
     the flag they want to alter
 */
-void set_pstate_flag(char flag, bool value) {
+void set_pstate_flag(MachineState *machine_state, char flag, bool value) {
     assert((flag == 'N') || (flag == 'C') || (flag == 'V') || (flag == 'Z'));
-    MachineState *ms_pointer = &machine_state;
+    // Evaluate pending flags first so they cannot overwrite this one later
+    read_pstate(machine_state);
     switch (flag) {
         case 'N':
-            ms_pointer->pstate.neg = value;
+            machine_state->pstate.neg = value;
             break;
         case 'C':
-            ms_pointer->pstate.carry = value;
+            machine_state->pstate.carry = value;
             break;
         case 'V':
-            ms_pointer->pstate.overflow = value;
+            machine_state->pstate.overflow = value;
             break;
         case 'Z':
-            ms_pointer->pstate.zero = value;
+            machine_state->pstate.zero = value;
             break;
         default:
             break;
     }
 }
+
+/*
+    A function that records the operands and result of a flag-setting
+    instruction, leaving the flags themselves to be evaluated by
+    read_pstate only when they are needed
+*/
+void set_lazy_flags(MachineState *machine_state, FlagsOperation operation, uint64_t rn_data, uint64_t op2, uint64_t res, unsigned char sf) {
+    LazyFlags *lazy_flags = &machine_state->lazy_flags;
+    lazy_flags->operation = operation;
+    lazy_flags->sf = sf;
+    lazy_flags->rn_data = rn_data;
+    lazy_flags->op2 = op2;
+    lazy_flags->res = res;
+}
+
+/*
+    A function that returns the pstate flags, first evaluating any
+    flags still pending from the last flag-setting instruction
+*/
+const ProcessorStateRegister *read_pstate(MachineState *machine_state) {
+    LazyFlags *lazy_flags = &machine_state->lazy_flags;
+    if (lazy_flags->operation == FLAGS_SETTLED) {
+        return &machine_state->pstate;
+    }
+
+    uint64_t rn_data = lazy_flags->rn_data;
+    uint64_t op2 = lazy_flags->op2;
+    uint64_t res = lazy_flags->res;
+    unsigned char sign_index = lazy_flags->sf ? 63 : 31;
+    ProcessorStateRegister *pstate = &machine_state->pstate;
+
+    pstate->neg = GET_BIT(res, sign_index);
+    pstate->zero = (res == 0);
+
+    switch (lazy_flags->operation) {
+        case FLAGS_ADD:
+            pstate->carry = (res < rn_data || res < op2);
+            // The operands are unsigned, so this never detects an overflow
+            pstate->overflow = (rn_data > 0 && op2 > 0 && res < 0) || (rn_data < 0 && op2 < 0 && res > 0);
+            break;
+        case FLAGS_SUB: {
+            bool rn_neg  = GET_BIT(rn_data, sign_index);
+            bool op2_neg = GET_BIT(op2, sign_index);
+            bool res_neg = GET_BIT(res, sign_index);
+            pstate->carry = (op2 <= rn_data);
+            pstate->overflow = (rn_neg && !op2_neg && !res_neg) || (!rn_neg && op2_neg && res_neg);
+            break;
+        }
+        default:
+            pstate->carry = 0;
+            pstate->overflow = 0;
+            break;
+    }
+
+    lazy_flags->operation = FLAGS_SETTLED;
+    return pstate;
+}
@@ -0,0 +1,223 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../headers/emulator.h"
+#include "../headers/memory.h"
+#include "../headers/registers.h"
+#include "../headers/snapshot.h"
+
+/* A snapshot file holds, in order:
+ *   a SnapshotHeader,
+ *   a SnapshotCore for each core,
+ *   the address of each saved page, in increasing order,
+ *   zero padding up to pages_offset, a multiple of PAGE_SIZE,
+ *   the contents of each saved page, PAGE_SIZE bytes each.
+ * Only pages that were loaded or written are saved. Integers are in the
+ * byte order of the host that wrote the file. Pages are page-aligned
+ * within the file, so a restore maps them rather than reading them. */
+
+// byte_order as the writing host stores it
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t num_cores;
+    uint32_t reserved;
+    uint64_t memory_size;
+    uint64_t num_pages;
+    uint64_t pages_offset;
+} SnapshotHeader;
+
+// Bits of SnapshotCore.pstate.
+enum { SNAPSHOT_N = 8, SNAPSHOT_Z = 4, SNAPSHOT_C = 2, SNAPSHOT_V = 1 };
+
+typedef struct {
+    uint64_t registers[NUM_GENERAL_REGISTERS];
+    uint64_t program_counter;
+    uint32_t pstate;
+    uint32_t halted;
+} SnapshotCore;
+
+// The pages of memory to save, gathered by visit_written_pages.
+typedef struct {
+    uint64_t num_pages;
+    uint64_t capacity;
+    uint64_t *addresses;
+    const unsigned char **bytes;
+} SavedPages;
+
+static void save_page(uint64_t address, const unsigned char *bytes, void *context) {
+    SavedPages *pages = context;
+    if (pages->num_pages == pages->capacity) {
+        pages->capacity = pages->capacity == 0 ? 64 : pages->capacity * 2;
+        pages->addresses = realloc(pages->addresses, pages->capacity * sizeof(uint64_t));
+        pages->bytes = realloc(pages->bytes, pages->capacity * sizeof(unsigned char *));
+        if (pages->addresses == NULL || pages->bytes == NULL) {
+            fprintf(stderr, "write_snapshot: ran out of memory\n");
+            exit(1);
+        }
+    }
+    pages->addresses[pages->num_pages] = address;
+    pages->bytes[pages->num_pages] = bytes;
+    pages->num_pages++;
+}
+
+static void write_bytes(FILE *file, const char *filename, const void *bytes, size_t size) {
+    if (fwrite(bytes, 1, size, file) != size) {
+        fprintf(stderr, "write_snapshot: couldn't write %s, errno %d\n", filename, errno);
+        exit(1);
+    }
+}
+
+/*
+    Saves the registers, flags and program counter of every core, along
+    with every page of memory that was loaded or written, into filename.
+*/
+void write_snapshot(Emulator *emulator, const char *filename) {
+    SavedPages pages = { 0 };
+    visit_written_pages(emulator, save_page, &pages);
+
+    uint64_t index_end = sizeof(SnapshotHeader) + emulator->num_cores * sizeof(SnapshotCore)
+                         + pages.num_pages * sizeof(uint64_t);
+    SnapshotHeader header = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .byte_order = SNAPSHOT_BYTE_ORDER,
+        .num_cores = emulator->num_cores,
+        .memory_size = get_memory_size(emulator),
+        .num_pages = pages.num_pages,
+        .pages_offset = (index_end + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE
+    };
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "write_snapshot: can't open %s, errno %d\n", filename, errno);
+        exit(1);
+    }
+    write_bytes(file, filename, &header, sizeof(header));
+
+    for (int i = 0; i < emulator->num_cores; i++) {
+        MachineState *machine_state = &emulator->cores[i].machine_state;
+        const ProcessorStateRegister *pstate = read_pstate(machine_state);
+        SnapshotCore core = {
+            .program_counter = machine_state->program_counter.data,
+            .pstate = (pstate->neg ? SNAPSHOT_N : 0) | (pstate->zero ? SNAPSHOT_Z : 0)
+                      | (pstate->carry ? SNAPSHOT_C : 0) | (pstate->overflow ? SNAPSHOT_V : 0),
+            .halted = machine_state->halted
+        };
+        for (int j = 0; j < NUM_GENERAL_REGISTERS; j++) {
+            core.registers[j] = machine_state->general_registers[j].data;
+        }
+        write_bytes(file, filename, &core, sizeof(core));
+    }
+
+    write_bytes(file, filename, pages.addresses, pages.num_pages * sizeof(uint64_t));
+    static const unsigned char padding[PAGE_SIZE];
+    write_bytes(file, filename, padding, header.pages_offset - index_end);
+    for (uint64_t i = 0; i < pages.num_pages; i++) {
+        write_bytes(file, filename, pages.bytes[i], PAGE_SIZE);
+    }
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "write_snapshot: couldn't write %s, errno %d\n", filename, errno);
+        exit(1);
+    }
+    free(pages.addresses);
+    free(pages.bytes);
+}
+
+static void invalid_snapshot(const char *filename, const char *reason) {
+    fprintf(stderr, "restore_snapshot: %s is not a valid snapshot: %s\n", filename, reason);
+    exit(1);
+}
+
+/*
+    Takes a snapshot written by write_snapshot, and a configuration whose
+    execution mode is used. Returns a machine with the number of cores
+    and memory size of the snapshot, in the state that was saved.
+    The file is mapped copy-on-write and its pages back guest memory
+    directly, so restoring takes the same time however much was saved.
+*/
+Emulator *restore_snapshot(const char *filename, const EmulatorConfig *config) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "restore_snapshot: can't open %s, errno %d\n", filename, errno);
+        exit(1);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0) {
+        fprintf(stderr, "restore_snapshot: can't stat %s, errno %d\n", filename, errno);
+        exit(1);
+    }
+    uint64_t size = file_stat.st_size;
+    if (size < sizeof(SnapshotHeader)) {
+        invalid_snapshot(filename, "too short");
+    }
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "restore_snapshot: can't map %s, errno %d\n", filename, errno);
+        exit(1);
+    }
+    close(fd);
+
+    // Check that everything the header describes lies within the file.
+    const SnapshotHeader *header = mapping;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        invalid_snapshot(filename, "bad magic number");
+    }
+    if (header->version != SNAPSHOT_VERSION || header->byte_order != SNAPSHOT_BYTE_ORDER) {
+        invalid_snapshot(filename, "written by another version or byte order");
+    }
+    if (header->num_cores < 1 || header->num_cores > MAX_CORES) {
+        invalid_snapshot(filename, "bad number of cores");
+    }
+    if (header->memory_size == 0 || header->memory_size > MAX_MEMORY_SIZE || header->memory_size % PAGE_SIZE != 0) {
+        invalid_snapshot(filename, "bad memory size");
+    }
+    uint64_t index_end = sizeof(SnapshotHeader) + header->num_cores * sizeof(SnapshotCore)
+                         + header->num_pages * sizeof(uint64_t);
+    if (header->num_pages > header->memory_size / PAGE_SIZE || header->pages_offset % PAGE_SIZE != 0
+        || header->pages_offset < index_end || header->pages_offset > size
+        || header->num_pages > (size - header->pages_offset) / PAGE_SIZE) {
+        invalid_snapshot(filename, "truncated");
+    }
+
+    EmulatorConfig restored = *config;
+    restored.num_cores = header->num_cores;
+    restored.memory_size = header->memory_size;
+    Emulator *emulator = emulator_create(&restored);
+
+    const SnapshotCore *cores = (const SnapshotCore *) (header + 1);
+    for (int i = 0; i < emulator->num_cores; i++) {
+        MachineState *machine_state = &emulator->cores[i].machine_state;
+        for (int j = 0; j < NUM_GENERAL_REGISTERS; j++) {
+            machine_state->general_registers[j].data = cores[i].registers[j];
+        }
+        machine_state->program_counter.data = cores[i].program_counter;
+        machine_state->pstate.neg = (cores[i].pstate & SNAPSHOT_N) != 0;
+        machine_state->pstate.zero = (cores[i].pstate & SNAPSHOT_Z) != 0;
+        machine_state->pstate.carry = (cores[i].pstate & SNAPSHOT_C) != 0;
+        machine_state->pstate.overflow = (cores[i].pstate & SNAPSHOT_V) != 0;
+        machine_state->halted = cores[i].halted != 0;
+    }
+
+    mapimage(emulator, mapping, size);
+    const uint64_t *addresses = (const uint64_t *) (cores + header->num_cores);
+    unsigned char *pages = (unsigned char *) mapping + header->pages_offset;
+    for (uint64_t i = 0; i < header->num_pages; i++) {
+        if (addresses[i] % PAGE_SIZE != 0 || addresses[i] >= header->memory_size
+            || (i > 0 && addresses[i] <= addresses[i - 1])) {
+            invalid_snapshot(filename, "bad page address");
+        }
+        mappage(emulator, addresses[i], pages + i * PAGE_SIZE);
+    }
+    return emulator;
+}
@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../headers/emulator.h"
+#include "../headers/timing.h"
+
+// Names of the instruction classes, as used in timing specifications.
+static const char *const class_names[NUM_INSTRUCTION_CLASSES] = {
+    [CLASS_DP_IMM] = "dp_imm",
+    [CLASS_DP_REG] = "dp_reg",
+    [CLASS_MULTIPLY] = "multiply",
+    [CLASS_SDT] = "sdt",
+    [CLASS_LOAD_LITERAL] = "load_literal",
+    [CLASS_BRANCH_TAKEN] = "taken",
+    [CLASS_BRANCH_UNTAKEN] = "untaken",
+};
+
+/*
+    Sets model to latencies in the style of an in-order Cortex-A53
+    running at 1.2 GHz, as on a Raspberry Pi 3, with loads and stores
+    hitting the L1 cache.
+*/
+void timing_default(TimingModel *model) {
+    model->latencies[CLASS_DP_IMM] = 1;
+    model->latencies[CLASS_DP_REG] = 1;
+    model->latencies[CLASS_MULTIPLY] = 3;
+    model->latencies[CLASS_SDT] = 4;
+    model->latencies[CLASS_LOAD_LITERAL] = 4;
+    model->latencies[CLASS_BRANCH_TAKEN] = 2;
+    model->latencies[CLASS_BRANCH_UNTAKEN] = 1;
+    model->clock_hz = 1200000000;
+}
+
+/*
+    Takes a comma separated list of class=cycles settings, such as
+    "sdt=3,taken=2", and clock=hz optionally suffixed with K, M or G.
+    Applies them to model. Returns false if spec is malformed.
+*/
+bool timing_parse(TimingModel *model, const char *spec) {
+    char *copy = strdup(spec);
+    if (copy == NULL) {
+        fprintf(stderr, "timing_parse: ran out of memory\n");
+        exit(1);
+    }
+
+    bool valid = true;
+    char *saveptr;
+    for (char *setting = strtok_r(copy, ",", &saveptr); setting != NULL && valid; setting = strtok_r(NULL, ",", &saveptr)) {
+        char *equals = strchr(setting, '=');
+        if (equals == NULL) {
+            fprintf(stderr, "timing_parse: expected class=cycles, not %s\n", setting);
+            valid = false;
+            break;
+        }
+        *equals = '\0';
+        char *value = equals + 1;
+
+        char *end;
+        errno = 0;
+        unsigned long long number = strtoull(value, &end, 10);
+        if (errno != 0 || end == value || value[0] == '-') {
+            fprintf(stderr, "timing_parse: %s must be a non-negative integer, not %s\n", setting, value);
+            valid = false;
+            break;
+        }
+
+        if (strcmp(setting, "clock") == 0) {
+            uint64_t multiplier = 1;
+            switch (*end) {
+                case 'K': case 'k': multiplier = 1000; end++; break;
+                case 'M': case 'm': multiplier = 1000000; end++; break;
+                case 'G': case 'g': multiplier = 1000000000; end++; break;
+            }
+            // a rate too large for 64 bits once scaled is as malformed as any other
+            bool overflows = number > UINT64_MAX / multiplier;
+            number *= multiplier;
+            if (*end != '\0' || number == 0 || overflows) {
+                fprintf(stderr, "timing_parse: clock must be a positive rate in Hz, not %s\n", value);
+                valid = false;
+            }
+            model->clock_hz = number;
+            continue;
+        }
+
+        int class = 0;
+        while (class < NUM_INSTRUCTION_CLASSES && strcmp(setting, class_names[class]) != 0) {
+            class++;
+        }
+        if (class == NUM_INSTRUCTION_CLASSES || *end != '\0') {
+            fprintf(stderr, "timing_parse: unknown setting %s=%s\n", setting, value);
+            valid = false;
+            break;
+        }
+        model->latencies[class] = number;
+    }
+
+    free(copy);
+    return valid;
+}
+
+/*
+    Takes the number of instructions of each class that a core ran.
+    Returns the cycles they took under model.
+*/
+uint64_t timing_cycles(const TimingModel *model, const uint64_t *class_counts) {
+    uint64_t cycles = 0;
+    for (int class = 0; class < NUM_INSTRUCTION_CLASSES; class++) {
+        cycles += class_counts[class] * model->latencies[class];
+    }
+    return cycles;
+}
+
+static uint64_t count_instructions(const uint64_t *class_counts) {
+    uint64_t instructions = 0;
+    for (int class = 0; class < NUM_INSTRUCTION_CLASSES; class++) {
+        instructions += class_counts[class];
+    }
+    return instructions;
+}
+
+/*
+    Writes a line giving the instructions, cycles and cycles per
+    instruction of the given class counts.
+*/
+static void write_totals(const TimingModel *model, const char *heading, const uint64_t *class_counts, FILE *file) {
+    uint64_t instructions = count_instructions(class_counts);
+    uint64_t cycles = timing_cycles(model, class_counts);
+    fprintf(file, "%s: %" PRIu64 " instructions, %" PRIu64 " cycles, CPI %.3f\n",
+            heading, instructions, cycles, instructions == 0 ? 0.0 : (double) cycles / instructions);
+}
+
+/*
+    Writes the cycles the machine's run took under model, broken down by
+    class of instruction. Each core of a machine with several cores is
+    listed as well; as the cores run side by side, the run takes as long
+    as the slowest of them.
+*/
+void timing_report(const TimingModel *model, Emulator *emulator, FILE *file) {
+    uint64_t class_counts[NUM_INSTRUCTION_CLASSES] = { 0 };
+    for (int i = 0; i < emulator->num_cores; i++) {
+        for (int class = 0; class < NUM_INSTRUCTION_CLASSES; class++) {
+            class_counts[class] += emulator->cores[i].class_counts[class];
+        }
+    }
+
+    write_totals(model, "Timing", class_counts, file);
+    uint64_t elapsed = 0;
+    for (int i = 0; i < emulator->num_cores; i++) {
+        if (emulator->num_cores > 1) {
+            char heading[32];
+            snprintf(heading, sizeof(heading), "Core %d", i);
+            write_totals(model, heading, emulator->cores[i].class_counts, file);
+        }
+        uint64_t cycles = timing_cycles(model, emulator->cores[i].class_counts);
+        if (cycles > elapsed) {
+            elapsed = cycles;
+        }
+    }
+    fprintf(file, "Elapsed: %" PRIu64 " cycles, %.6g s at %.1f MHz\n",
+            elapsed, (double) elapsed / model->clock_hz, model->clock_hz / 1e6);
+
+    fprintf(file, "%-14s %20s %8s %20s\n", "class", "count", "latency", "cycles");
+    for (int class = 0; class < NUM_INSTRUCTION_CLASSES; class++) {
+        fprintf(file, "%-14s %20" PRIu64 " %8" PRIu64 " %20" PRIu64 "\n", class_names[class],
+                class_counts[class], model->latencies[class], class_counts[class] * model->latencies[class]);
+    }
+}
@@ -0,0 +1,290 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../headers/emulator.h"
+#include "../headers/memory.h"
+#include "../headers/registers.h"
+#include "../headers/trace.h"
+
+// Size of the ring buffer between the emulator and the writer thread.
+#define TRACE_RING_SIZE (1 << 22)
+// The writer is woken once this much of the ring buffer has filled.
+#define TRACE_CHUNK (1 << 16)
+// Largest possible record, with every register written.
+#define TRACE_MAX_RECORD 512
+// Most memory accesses made by one instruction.
+#define TRACE_MAX_ACCESSES 2
+
+// What the reader will know about a core after the records so far.
+typedef struct {
+    uint64_t registers[NUM_GENERAL_REGISTERS];
+    uint64_t next_pc;
+    uint64_t memory_address;
+    unsigned char flags;
+} TraceModel;
+
+/*
+    A trace being recorded. The emulator encodes records into the ring
+    buffer and a writer thread drains it to the file, so the emulator only
+    waits if the file cannot keep up with it.
+*/
+struct trace {
+    FILE *file;
+    const char *filename;
+    pthread_t writer;
+
+    unsigned char *ring;
+    // total bytes ever put into and taken out of the ring buffer
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    // head when the writer was last woken; only used by the emulator
+    uint64_t signalled;
+
+    // guard done and emulator_waiting, and the waits on the conditions
+    pthread_mutex_t lock;
+    pthread_cond_t data_ready;
+    pthread_cond_t space_ready;
+    bool done;
+    bool emulator_waiting;
+
+    // The instruction being run.
+    uint32_t pc;
+    uint32_t inst;
+    uint64_t registers_before[NUM_GENERAL_REGISTERS];
+    int num_accesses;
+    struct {
+        uint64_t address;
+        unsigned char kind;
+    } accesses[TRACE_MAX_ACCESSES];
+
+    int last_core;
+    TraceModel models[MAX_CORES];
+};
+
+/*
+    Writes everything put into the ring buffer to the file, until the
+    trace is closed and the ring buffer is empty.
+*/
+static void *run_writer(void *arg) {
+    Trace *trace = arg;
+    bool finished;
+    do {
+        pthread_mutex_lock(&trace->lock);
+        while (!trace->done && !trace->emulator_waiting
+               && atomic_load(&trace->head) - atomic_load(&trace->tail) < TRACE_CHUNK) {
+            pthread_cond_wait(&trace->data_ready, &trace->lock);
+        }
+        finished = trace->done;
+        pthread_mutex_unlock(&trace->lock);
+
+        uint64_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+        while (tail < head) {
+            uint64_t offset = tail % TRACE_RING_SIZE;
+            uint64_t length = head - tail < TRACE_RING_SIZE - offset ? head - tail : TRACE_RING_SIZE - offset;
+            if (fwrite(trace->ring + offset, 1, length, trace->file) != length) {
+                fprintf(stderr, "trace: couldn't write %s, errno %d\n", trace->filename, errno);
+                exit(1);
+            }
+            tail += length;
+        }
+        atomic_store_explicit(&trace->tail, tail, memory_order_release);
+
+        pthread_mutex_lock(&trace->lock);
+        pthread_cond_broadcast(&trace->space_ready);
+        pthread_mutex_unlock(&trace->lock);
+    } while (!finished);
+    return NULL;
+}
+
+/*
+    Takes the name of the file to record into.
+    Returns a trace, with its writer thread started.
+*/
+Trace *trace_open(const char *filename) {
+    Trace *trace = calloc(1, sizeof(Trace));
+    unsigned char *ring = malloc(TRACE_RING_SIZE);
+    if (trace == NULL || ring == NULL) {
+        fprintf(stderr, "trace_open: ran out of memory\n");
+        exit(1);
+    }
+    trace->ring = ring;
+    trace->filename = filename;
+    for (int i = 0; i < MAX_CORES; i++) {
+        trace->models[i].flags = TRACE_RESET_FLAGS;
+    }
+    trace->file = fopen(filename, "wb");
+    if (trace->file == NULL) {
+        fprintf(stderr, "trace_open: can't open %s, errno %d\n", filename, errno);
+        exit(1);
+    }
+
+    unsigned char header[sizeof(TRACE_MAGIC) + 4];
+    memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    for (int i = 0; i < 4; i++) {
+        header[sizeof(TRACE_MAGIC) + i] = (uint32_t) TRACE_VERSION >> (8 * i);
+    }
+    if (fwrite(header, 1, sizeof(header), trace->file) != sizeof(header)) {
+        fprintf(stderr, "trace_open: couldn't write %s, errno %d\n", filename, errno);
+        exit(1);
+    }
+
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->data_ready, NULL);
+    pthread_cond_init(&trace->space_ready, NULL);
+    if (pthread_create(&trace->writer, NULL, run_writer, trace) != 0) {
+        fprintf(stderr, "trace_open: can't start the writer\n");
+        exit(1);
+    }
+    return trace;
+}
+
+/*
+    Waits for the writer to write out every record, then closes the file
+    and frees the trace.
+*/
+void trace_close(Trace *trace) {
+    pthread_mutex_lock(&trace->lock);
+    trace->done = true;
+    pthread_cond_signal(&trace->data_ready);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->writer, NULL);
+
+    if (fclose(trace->file) != 0) {
+        fprintf(stderr, "trace_close: couldn't write %s, errno %d\n", trace->filename, errno);
+        exit(1);
+    }
+    pthread_mutex_destroy(&trace->lock);
+    pthread_cond_destroy(&trace->data_ready);
+    pthread_cond_destroy(&trace->space_ready);
+    free(trace->ring);
+    free(trace);
+}
+
+/*
+    Copies a record into the ring buffer, waiting for the writer to make
+    room if it is full, and wakes the writer once a chunk is ready.
+*/
+static void put_record(Trace *trace, const unsigned char *record, size_t size) {
+    uint64_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    if (TRACE_RING_SIZE - (head - atomic_load_explicit(&trace->tail, memory_order_acquire)) < size) {
+        pthread_mutex_lock(&trace->lock);
+        trace->emulator_waiting = true;
+        pthread_cond_signal(&trace->data_ready);
+        while (TRACE_RING_SIZE - (head - atomic_load_explicit(&trace->tail, memory_order_acquire)) < size) {
+            pthread_cond_wait(&trace->space_ready, &trace->lock);
+        }
+        trace->emulator_waiting = false;
+        pthread_mutex_unlock(&trace->lock);
+    }
+
+    uint64_t offset = head % TRACE_RING_SIZE;
+    size_t first = size < TRACE_RING_SIZE - offset ? size : TRACE_RING_SIZE - offset;
+    memcpy(trace->ring + offset, record, first);
+    memcpy(trace->ring, record + first, size - first);
+    atomic_store_explicit(&trace->head, head + size, memory_order_release);
+
+    if (head + size - trace->signalled >= TRACE_CHUNK) {
+        trace->signalled = head + size;
+        pthread_mutex_lock(&trace->lock);
+        pthread_cond_signal(&trace->data_ready);
+        pthread_mutex_unlock(&trace->lock);
+    }
+}
+
+static unsigned char *put_varint(unsigned char *out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+// Maps signed differences to unsigned ones, keeping small differences small.
+static uint64_t zigzag(uint64_t difference) {
+    return (difference << 1) ^ (uint64_t) -(difference >> 63);
+}
+
+/*
+    Notes the state of the core before it runs its next instruction.
+*/
+void trace_step_begin(Trace *trace, Core *core) {
+    MachineState *machine_state = &core->machine_state;
+    trace->pc = machine_state->program_counter.data;
+    trace->inst = readmem32(core->emulator, trace->pc);
+    for (int i = 0; i < NUM_GENERAL_REGISTERS; i++) {
+        trace->registers_before[i] = machine_state->general_registers[i].data;
+    }
+    trace->num_accesses = 0;
+}
+
+/*
+    Notes a memory access made by the instruction being run.
+*/
+void trace_memory(Trace *trace, uint64_t address, bool store, unsigned char sf) {
+    if (trace->num_accesses < TRACE_MAX_ACCESSES) {
+        trace->accesses[trace->num_accesses].address = address;
+        trace->accesses[trace->num_accesses].kind = (store ? TRACE_STORE : 0) | (sf ? TRACE_WIDE : 0);
+        trace->num_accesses++;
+    }
+}
+
+/*
+    Records the instruction the core has just run.
+*/
+void trace_step_end(Trace *trace, Core *core) {
+    MachineState *machine_state = &core->machine_state;
+    TraceModel *model = &trace->models[core->id];
+    unsigned char record[TRACE_MAX_RECORD];
+    unsigned char *out = record + 1;
+    unsigned char tag = 0;
+
+    if (core->id != trace->last_core) {
+        tag |= TRACE_CORE;
+        out = put_varint(out, core->id);
+        trace->last_core = core->id;
+    }
+    if (trace->pc != model->next_pc) {
+        tag |= TRACE_JUMP;
+        out = put_varint(out, zigzag(trace->pc - model->next_pc));
+    }
+    model->next_pc = (uint64_t) trace->pc + 4;
+    for (int i = 0; i < 4; i++) {
+        *out++ = trace->inst >> (8 * i);
+    }
+
+    const ProcessorStateRegister *pstate = read_pstate(machine_state);
+    unsigned char flags = (pstate->neg ? TRACE_N : 0) | (pstate->zero ? TRACE_Z : 0)
+                          | (pstate->carry ? TRACE_C : 0) | (pstate->overflow ? TRACE_V : 0);
+    if (flags != model->flags) {
+        tag |= TRACE_FLAGS;
+        *out++ = flags;
+        model->flags = flags;
+    }
+
+    unsigned char *num_written = out++;
+    *num_written = 0;
+    for (int i = 0; i < NUM_GENERAL_REGISTERS; i++) {
+        uint64_t value = machine_state->general_registers[i].data;
+        if (value != trace->registers_before[i] || value != model->registers[i]) {
+            *out++ = i;
+            out = put_varint(out, zigzag(value - model->registers[i]));
+            model->registers[i] = value;
+            (*num_written)++;
+        }
+    }
+
+    *out++ = trace->num_accesses;
+    for (int i = 0; i < trace->num_accesses; i++) {
+        *out++ = trace->accesses[i].kind;
+        out = put_varint(out, zigzag(trace->accesses[i].address - model->memory_address));
+        model->memory_address = trace->accesses[i].address;
+    }
+
+    record[0] = tag;
+    put_record(trace, record, out - record);
+}
@@ -0,0 +1,57 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "execute.h"
+#include "instructions.h"
+#include "registers.h"
+
+// Number of translated blocks held; must be a power of two.
+#define BLOCK_CACHE_ENTRIES 512
+// Maximum number of instructions translated into a single block.
+#define MAX_BLOCK_OPS 32
+
+typedef struct core Core;
+typedef struct block_op BlockOp;
+typedef struct block_cache BlockCache;
+
+/*
+    A pre-resolved handler for one translated instruction.
+    Returns false once control leaves the block.
+*/
+typedef bool (*BlockHandler)(Core *core, const BlockOp *op);
+
+struct block_op {
+    BlockHandler handler;
+    // address the instruction was translated from
+    uint32_t address;
+    unsigned char sf;
+    // whether a transfer is a load rather than a store
+    bool load;
+    unsigned char rd;
+    unsigned char rn;
+    unsigned char rm;
+    // shift selector (opr), cond, or ra, depending on the handler
+    unsigned char selector;
+    // shift amount, or whether the operation is negated
+    unsigned char amount;
+    union {
+        DPFunction dp;
+        WideMoveFunction wide_move;
+    } function;
+    // pre-shifted immediate, signed offset or resolved target address
+    uint64_t imm;
+    // the decoded instruction, for handlers that defer to execute()
+    Instruction inst;
+};
+
+extern void block_cache_init(Core *core);
+
+extern void block_cache_free(Core *core);
+
+extern void block_invalidate(Core *core, uint32_t address, uint32_t numbytes);
+
+extern void run_blocks(Core *core);
+
+#endif
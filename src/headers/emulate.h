@@ -1,8 +1,6 @@
 #ifndef EMULATE_H
 #define EMULATE_H
 
-extern char *get_output_file(void);
-
 extern int run_emulator(int argc, char **argv);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+// A header file describing an emulator instance and its API.
+
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "block.h"
+#include "icache.h"
+#include "jit.h"
+#include "memory.h"
+#include "profile.h"
+#include "registers.h"
+#include "timing.h"
+#include "trace.h"
+
+// Largest number of cores a machine may have.
+#define MAX_CORES 256
+
+// How instructions are run.
+typedef enum { INTERPRET, BLOCKS, JIT } ExecutionMode;
+
+typedef struct {
+    // size of the guest address space in bytes
+    uint64_t memory_size;
+    ExecutionMode execution_mode;
+    // number of cores sharing the guest memory
+    int num_cores;
+    // run the cores on one thread, an instruction at a time in turn,
+    // rather than on a thread each
+    bool round_robin;
+} EmulatorConfig;
+
+/*
+    A core of the guest machine: its registers and everything it has
+    cached about the code it runs. A core's state is only ever touched
+    from the thread running it.
+*/
+struct core {
+    // the machine the core belongs to
+    Emulator *emulator;
+    int id;
+    MachineState machine_state;
+    ICache icache;
+    // allocated on first use by run_blocks and run_jit respectively
+    BlockCache *block_cache;
+    JitState *jit;
+    // set by other cores when they overwrite code this core may have cached
+    atomic_bool code_changed;
+    // whether the instructions run are counted by class for the timing model
+    bool timed;
+    uint64_t class_counts[NUM_INSTRUCTION_CLASSES];
+};
+
+/*
+    A guest machine. Everything the emulator reads or writes while running
+    a program lives here, so instances are independent of each other and
+    may be run concurrently from different threads.
+*/
+struct emulator {
+    Memory memory;
+    Core *cores;
+    int num_cores;
+    ExecutionMode execution_mode;
+    bool round_robin;
+    // where the output is printed once every core halts, or stdout if NULL
+    const char *output_file;
+    // records every instruction run, if set
+    Trace *trace;
+    // counts every instruction run, if set
+    Profile *profile;
+    // latencies the instructions run are charged, if set
+    const TimingModel *timing;
+};
+
+extern Emulator *emulator_create(const EmulatorConfig *config);
+
+extern void emulator_load(Emulator *emulator, const char *filename);
+
+extern void emulator_set_output(Emulator *emulator, const char *output_file);
+
+extern void emulator_set_trace(Emulator *emulator, Trace *trace);
+
+extern void emulator_set_profile(Emulator *emulator, Profile *profile);
+
+extern void emulator_set_timing(Emulator *emulator, const TimingModel *timing);
+
+extern bool emulator_step(Emulator *emulator);
+
+extern void emulator_run(Emulator *emulator);
+
+extern bool emulator_halted(const Emulator *emulator);
+
+extern MachineState *emulator_machine_state(Emulator *emulator, int core);
+
+extern void emulator_destroy(Emulator *emulator);
+
+extern void sync_core_code(Core *core);
+
+#endif
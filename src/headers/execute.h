@@ -1,8 +1,33 @@
 #ifndef EXECUTE_H
 #define EXECUTE_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "instructions.h"
+#include "registers.h"
 
-extern void execute(Instruction *inst);
+typedef struct core Core;
+
+// Data processing operations sharing one signature, selected by opc.
+typedef void (*DPFunction)(MachineState *machine_state, unsigned char rd, uint64_t rn_data, uint64_t op2, unsigned char sf);
+typedef void (*WideMoveFunction)(MachineState *machine_state, unsigned char rd, uint64_t operand, unsigned char hw, unsigned char sf);
+
+extern const DPFunction arith_functions[];
+
+extern const DPFunction logical_functions[];
+
+extern const WideMoveFunction wide_move_functions[];
+
+extern uint64_t shift_operand(uint64_t rm_data, unsigned char opr, unsigned char operand, unsigned char sf);
+
+extern void execute_multiply(MachineState *machine_state, unsigned char rd, uint64_t rn_data, uint64_t rm_data, unsigned char ra, bool negate, unsigned char sf);
+
+extern void execute_transfer(Core *core, bool load, unsigned char rt, uint64_t address, unsigned char sf);
+
+extern uint64_t branch_target(uint64_t pc, int32_t enc_address);
+
+extern bool condition_holds(MachineState *machine_state, unsigned char cond);
+
+extern void execute(Core *core, const Instruction *inst);
 
 #endif
@@ -2,9 +2,9 @@
 #define FETCH_H
 
 #include <stdint.h>
-#include "memory.h"
-#include "registers.h"
 
-extern uint32_t fetch(MachineState *machine_state);
+typedef struct core Core;
+
+extern uint32_t fetch(Core *core);
 
 #endif
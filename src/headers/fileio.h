@@ -1,10 +1,11 @@
 #ifndef FILEIO_H
 #define FILEIO_H
-#include "registers.h"
 
-extern void store_file_to_mem(char *filename);
+typedef struct emulator Emulator;
 
-extern void print_output(MachineState *machine_state, char *filename);
+extern void store_file_to_mem(Emulator *emulator, const char *filename);
+
+extern void print_output(Emulator *emulator, const char *filename);
 
 #endif
 
@@ -0,0 +1,6 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+extern int run_fuzz(int argc, char **argv);
+
+#endif
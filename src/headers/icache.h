@@ -0,0 +1,38 @@
+#ifndef ICACHE_H
+#define ICACHE_H
+
+#include <stdint.h>
+#include "instructions.h"
+#include "registers.h"
+
+// Number of predecoded instructions held; must be a power of two.
+#define ICACHE_ENTRIES 4096
+
+typedef struct core Core;
+
+typedef struct {
+    // the entry is valid while this matches the cache's generation
+    uint32_t generation;
+    uint32_t tag;
+    Instruction inst;
+} ICacheEntry;
+
+/*
+    A direct-mapped cache of decoded instructions, indexed by the word
+    address of the program counter. The tag is the full address the
+    instruction was fetched from, so unaligned branch targets are cached
+    separately from the aligned word they start in.
+*/
+typedef struct {
+    // bumped to invalidate every entry at once; entries never match 0
+    uint32_t generation;
+    ICacheEntry entries[ICACHE_ENTRIES];
+} ICache;
+
+extern void icache_init(Core *core);
+
+extern const Instruction *icache_lookup(Core *core);
+
+extern void icache_invalidate(Core *core, uint32_t address, uint32_t numbytes);
+
+#endif
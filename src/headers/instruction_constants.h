@@ -17,10 +17,30 @@
 // returns a number sign extended from width FROM casted to intTO_t, assuming this is defined in <stdint.h>
 #define SIGN_EXTEND(num, FROM, TO) ((int##TO##_t) (num | ((GET_BIT(num, FROM - 1)) ? SET_BITS(FROM, TO) : 0)))
 
+/* The encoder and decoder both lay out fields through these, so that each
+ * field's position is given once below, by FIELD_START and FIELD_END for a
+ * field of several bits, or FIELD_BIT for a single bit. */
+// returns field FIELD of word, shifted so that its lowest bit is bit 0
+#define GET_FIELD(word, FIELD) BITMASK(word, FIELD##_START, FIELD##_END)
+// returns value cut to the width of field FIELD, shifted into its place in a word
+#define PUT_FIELD(value, FIELD) \
+    ((uint32_t) BITMASK((uint64_t) (value), 0, FIELD##_END - FIELD##_START) << FIELD##_START)
+// returns the single bit field FLAG of word
+#define GET_FLAG(word, FLAG) GET_BIT(word, FLAG##_BIT)
+// returns the lowest bit of value, shifted into the place of field FLAG in a word
+#define PUT_FLAG(value, FLAG) ((uint32_t) ((value) & 0x1) << FLAG##_BIT)
+
 // start and end of RD or RT
 #define RD_RT_START 0
 #define RD_RT_END   4
 
+// op0, bits 25-28, selects the group of an instruction:
+// 100X DP (immediate), X101 DP (register) including HALT,
+// 1100 single data transfer and load literal, 101X branch
+#define OP0_START 25
+#define OP0_END   28
+#define NUM_OP0   16
+
 /*
  * Constants for DP instructions
  */
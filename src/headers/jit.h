@@ -0,0 +1,27 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct core Core;
+typedef struct jit_state JitState;
+
+// Number of block entry points tracked; must be a power of two.
+#define JIT_CACHE_ENTRIES 1024
+// Number of times a block must be entered before it is compiled.
+#define JIT_THRESHOLD 16
+// Maximum number of instructions compiled into a single block.
+#define JIT_MAX_BLOCK_INSTS 64
+// Size of the executable buffer holding compiled code.
+#define JIT_BUFFER_SIZE (1 << 20)
+
+extern void jit_cache_init(Core *core);
+
+extern void jit_free(Core *core);
+
+extern void jit_invalidate(Core *core, uint32_t address, uint32_t numbytes);
+
+extern void run_jit(Core *core);
+
+#endif
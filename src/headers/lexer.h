@@ -0,0 +1,41 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+/** A module for splitting the operands of an instruction into tokens.
+ * A line is scanned once, and each token keeps a pointer to its first character, for error columns.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "instructions.h"
+
+// the most tokens in the operands of one line, including the final TOKEN_END
+#define MAX_TOKENS 16
+
+typedef enum {
+    TOKEN_END,       // end of the line
+    TOKEN_REGISTER,  // wn, xn, wzr or xzr
+    TOKEN_IMMEDIATE, // #n, with n decimal or hexadecimal with 0x, and optionally negative
+    TOKEN_NUMBER,    // n without #, as for a literal address
+    TOKEN_WORD,      // any other run of characters, as for a label or shift
+    TOKEN_LBRACKET,  // [
+    TOKEN_RBRACKET,  // ]
+    TOKEN_COMMA,     // ,
+    TOKEN_BANG       // !
+} TokenType;
+
+typedef struct {
+    TokenType type;
+    const char *start;
+    union {
+        struct {
+            uint8_t index;
+            RegisterWidth width;
+        } reg;
+        int64_t value;
+    } data;
+} Token;
+
+bool lex_operands(const char *src, Token tokens[MAX_TOKENS], const char **error_at);
+
+#endif
@@ -1,19 +1,64 @@
 #ifndef MEMORY_H
 #define MEMORY_H
+#include <pthread.h>
 #include <stdint.h>
 
+// Default size of the guest address space.
 #define MEMORY_SIZE 2097152
+// Largest address space, keeping every address within 32 bits.
+#define MAX_MEMORY_SIZE (1ULL << 32)
+// Memory is allocated a page at a time, as it is first written.
+#define PAGE_SIZE 4096
 
-extern void initmem(void);
+typedef struct core Core;
+typedef struct emulator Emulator;
+typedef struct page_table PageTable;
 
-extern void loadtomem(void *arr, uint32_t numbytes);
+/*
+    Guest memory as a two-level page table, allocated as it is touched.
+    Untouched pages read as zero. Memory is shared by every core of the
+    machine: tables and pages are published atomically, so cores on other
+    threads can read them without taking the lock.
+*/
+typedef struct {
+    // size of the guest address space in bytes
+    uint64_t size;
+    PageTable *_Atomic *page_tables;
+    uint64_t num_page_tables;
+    // held while a table or page is created; owned by the emulator
+    pthread_mutex_t lock;
+    // private mapping of the image loaded by maptomem, if any
+    void *image;
+    uint64_t image_size;
+} Memory;
 
-extern uint32_t readmem32(uint32_t address);
+// Called with the address and little-endian contents of a page.
+typedef void (*PageVisitor)(uint64_t address, const unsigned char *bytes, void *context);
 
-extern uint64_t readmem64(uint32_t address);
+extern void initmem(Emulator *emulator, uint64_t size);
 
-extern void writemem32(uint32_t address, uint32_t data);
+extern void freemem(Emulator *emulator);
 
-extern void writemem64(uint32_t address, uint64_t data);
+extern uint64_t get_memory_size(const Emulator *emulator);
+
+extern void loadtomem(Emulator *emulator, void *arr, uint32_t numbytes);
+
+extern void mapimage(Emulator *emulator, void *image, uint64_t size);
+
+extern void mappage(Emulator *emulator, uint64_t address, unsigned char *bytes);
+
+extern void maptomem(Emulator *emulator, void *mapping, uint64_t numbytes);
+
+extern void visit_written_pages(const Emulator *emulator, PageVisitor visit, void *context);
+
+extern void mark_code(Emulator *emulator, uint32_t address, uint64_t numbytes);
+
+extern uint32_t readmem32(Emulator *emulator, uint64_t address);
+
+extern uint64_t readmem64(Emulator *emulator, uint64_t address);
+
+extern void writemem32(Core *core, uint64_t address, uint32_t data);
+
+extern void writemem64(Core *core, uint64_t address, uint64_t data);
 
 #endif
@@ -22,10 +22,17 @@ extern const char *const shift_types[];
 typedef enum { COND, UNCOND, LOAD } LiteralInstr;
 typedef enum { LSL, LSR, ASR, ROR } ShiftType;
 
+// The first error found in the operands of an instruction: what was expected, and the character it was found at.
+typedef struct {
+    const char *message;
+    const char *at;
+} ParseError;
+
 void set_offset(Instruction *inst, uint32_t inst_pos, uint32_t target_pos);
 bool skip_whitespace(char **src);
 bool parse_label(char **src, uint32_t inst_pos, SymbolTable table);
 bool parse_directive(char **src, int32_t *dest);
-bool parse_instruction(char **src, Instruction *instruction, uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table);
+bool parse_instruction(char **src, Instruction *instruction, uint32_t cur_pos, SymbolTable known_table, SymbolTable unknown_table,
+                       ParseError *error);
 
 #endif
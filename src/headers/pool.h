@@ -0,0 +1,16 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/*
+    A task run by the pool: the index of the task to run and the index of
+    the worker running it, which is below the number of workers.
+*/
+typedef void (*PoolTask)(void *context, size_t task, int worker);
+
+extern int host_cores(void);
+
+extern void run_pool(size_t num_tasks, int num_workers, PoolTask task, void *context);
+
+#endif
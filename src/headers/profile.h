@@ -0,0 +1,24 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "instructions.h"
+
+// Number of entries listed in each table of the report.
+#define PROFILE_REPORT_ENTRIES 20
+
+typedef struct profile Profile;
+
+extern Profile *profile_new(int num_cores);
+
+extern void profile_free(Profile *profile);
+
+extern bool profile_load_symbols(Profile *profile, const char *filename);
+
+extern void profile_record(Profile *profile, int core, uint32_t pc, const Instruction *inst, bool taken);
+
+extern void profile_report(Profile *profile, FILE *file);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+/** A module for storing the lines of an assembled program.
+ * Lines are allocated in chunks which are never moved, so pointers to lines stay valid as the program grows.
+ * When streaming, only the instructions waiting on a forward reference are kept, as pending lines.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "instructions.h"
+
+typedef struct {
+    bool is_instruction;
+    union {
+        int32_t directive;
+        Instruction inst;
+    } data;
+} ProgramLine;
+
+typedef struct program *Program;
+typedef struct pending *PendingLines;
+
+Program program_new(void);
+
+void program_free(Program program);
+
+uint32_t program_size(Program program);
+
+ProgramLine *program_line(Program program, uint32_t pos);
+
+ProgramLine *program_append(Program program);
+
+PendingLines pending_new(void);
+
+void pending_free(PendingLines pending);
+
+bool pending_add(PendingLines pending, uint32_t pos, const Instruction *inst);
+
+Instruction *pending_get(PendingLines pending, uint32_t pos);
+
+void pending_remove(PendingLines pending, uint32_t pos);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef READTRACE_H
+#define READTRACE_H
+
+extern int run_trace_reader(int argc, char **argv);
+
+#endif
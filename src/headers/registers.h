@@ -19,23 +19,47 @@ typedef struct {
     bool overflow:1;
 } ProcessorStateRegister;
 
+// The kind of instruction whose flags are still to be evaluated.
+typedef enum { FLAGS_SETTLED, FLAGS_ADD, FLAGS_SUB, FLAGS_LOGICAL } FlagsOperation;
+
+/*
+    The operands and result of the last flag-setting instruction, kept so
+    that NZCV is only computed when something reads pstate.
+    Operands and result are already truncated to 32 bits when sf is 0.
+*/
+typedef struct {
+    FlagsOperation operation;
+    unsigned char sf;
+    uint64_t rn_data;
+    uint64_t op2;
+    uint64_t res;
+} LazyFlags;
+
 typedef struct {
     Register general_registers[NUM_GENERAL_REGISTERS];
     Register zero_register;
     Register program_counter;
     ProcessorStateRegister pstate;
+    // pstate is only up to date while lazy_flags.operation is FLAGS_SETTLED
+    LazyFlags lazy_flags;
+    // set by HALT; the core runs no further instructions
+    bool halted;
 } MachineState;
 
-extern void init_machine_state(void);
+extern void init_machine_state(MachineState *machine_state);
+
+extern uint64_t read_general_registers(const MachineState *machine_state, int index);
+
+extern void write_general_registers(MachineState *machine_state, int index, uint64_t value);
 
-extern MachineState read_machine_state(void);
+extern void write_program_counter(MachineState *machine_state, uint32_t address);
 
-extern void write_general_registers(int index, uint64_t value);
+extern void increment_pc(MachineState *machine_state);
 
-extern void write_program_counter(uint32_t address);
+extern void set_pstate_flag(MachineState *machine_state, char flag, bool value);
 
-extern void increment_pc(void);
+extern void set_lazy_flags(MachineState *machine_state, FlagsOperation operation, uint64_t rn_data, uint64_t op2, uint64_t res, unsigned char sf);
 
-extern void set_pstate_flag(char flag, bool value);
+extern const ProcessorStateRegister *read_pstate(MachineState *machine_state);
 
 #endif
@@ -0,0 +1,14 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "emulator.h"
+
+// Identifies a snapshot file, and the version of its format.
+#define SNAPSHOT_MAGIC "ARMSNAP"
+#define SNAPSHOT_VERSION 1
+
+extern void write_snapshot(Emulator *emulator, const char *filename);
+
+extern Emulator *restore_snapshot(const char *filename, const EmulatorConfig *config);
+
+#endif
@@ -16,6 +16,8 @@ void symtable_free(SymbolTable symtable);
 
 bool symtable_empty(SymbolTable symtable);
 
+uint32_t symtable_size(SymbolTable symtable);
+
 bool symtable_contains(SymbolTable symtable, const char *key);
 
 bool symtable_get(SymbolTable symtable, const char *key, uint32_t *dest);
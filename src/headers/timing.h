@@ -0,0 +1,39 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct emulator Emulator;
+
+// Classes of instruction that the timing model charges latencies for.
+typedef enum {
+    CLASS_DP_IMM,
+    CLASS_DP_REG,
+    CLASS_MULTIPLY,
+    CLASS_SDT,
+    CLASS_LOAD_LITERAL,
+    CLASS_BRANCH_TAKEN,
+    CLASS_BRANCH_UNTAKEN,
+    NUM_INSTRUCTION_CLASSES
+} InstructionClass;
+
+/*
+    The cost of each class of instruction in cycles, and the clock rate
+    used to turn cycles into time.
+*/
+typedef struct {
+    uint64_t latencies[NUM_INSTRUCTION_CLASSES];
+    uint64_t clock_hz;
+} TimingModel;
+
+extern void timing_default(TimingModel *model);
+
+extern bool timing_parse(TimingModel *model, const char *spec);
+
+extern uint64_t timing_cycles(const TimingModel *model, const uint64_t *class_counts);
+
+extern void timing_report(const TimingModel *model, Emulator *emulator, FILE *file);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A trace file starts with TRACE_MAGIC (8 bytes including the NUL), then
+ * the format version as a little-endian 32-bit integer. A record for each
+ * instruction run follows:
+ *   tag byte, a combination of the TRACE_* flags below;
+ *   the core ID as a varint, if TRACE_CORE is set;
+ *   the PC, if TRACE_JUMP is set, as a zigzag varint of its difference
+ *   from the address after the core's previous instruction;
+ *   the instruction word, 4 bytes little-endian;
+ *   NZCV in the low 4 bits of a byte, if TRACE_FLAGS is set, which it is
+ *   only when the flags differ from those last traced for the core;
+ *   the number of registers changed, then for each its index and a zigzag
+ *   varint of its difference from the value last traced for it. Only
+ *   registers whose value changed are listed, so an instruction that writes
+ *   a register's existing value back into it records nothing for it;
+ *   the number of memory accesses, then for each a kind byte (TRACE_STORE,
+ *   TRACE_WIDE) and a zigzag varint of the address's difference from the
+ *   core's previous access.
+ * Every core's previous values start at zero, apart from its flags, which
+ * start at TRACE_RESET_FLAGS as the machine's do on reset, and its first
+ * instruction is expected at address 0. */
+
+#define TRACE_MAGIC "ARMTRACE"
+#define TRACE_VERSION 2
+
+// Flags of a record's tag byte.
+#define TRACE_CORE  0x1
+#define TRACE_JUMP  0x2
+#define TRACE_FLAGS 0x4
+
+// Flags of a memory access's kind byte.
+#define TRACE_STORE 0x1
+#define TRACE_WIDE  0x2
+
+// NZCV bits of a record's flags byte.
+#define TRACE_N 0x8
+#define TRACE_Z 0x4
+#define TRACE_C 0x2
+#define TRACE_V 0x1
+
+// NZCV of every core before its first record, matching init_machine_state.
+#define TRACE_RESET_FLAGS TRACE_Z
+
+typedef struct core Core;
+typedef struct trace Trace;
+
+extern Trace *trace_open(const char *filename);
+
+extern void trace_close(Trace *trace);
+
+extern void trace_step_begin(Trace *trace, Core *core);
+
+extern void trace_memory(Trace *trace, uint64_t address, bool store, unsigned char sf);
+
+extern void trace_step_end(Trace *trace, Core *core);
+
+#endif
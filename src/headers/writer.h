@@ -0,0 +1,33 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+/** A module for writing the words of an assembled program to the output file.
+ * A whole program is encoded into an image of the file, mapped into memory when the file allows it.
+ * A streamed program is appended through a buffer, and words already written can be patched.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct writer *Writer;
+
+Writer writer_new(FILE *output_file);
+
+void writer_free(Writer writer);
+
+uint8_t *writer_map(Writer writer, uint32_t num_words);
+
+bool writer_unmap(Writer writer);
+
+bool writer_write(Writer writer, uint32_t word);
+
+bool writer_patch(Writer writer, uint32_t pos, uint32_t word);
+
+bool writer_flush(Writer writer);
+
+bool writer_seekable(Writer writer);
+
+void put_word(uint8_t *dest, uint32_t word);
+
+#endif
@@ -0,0 +1,159 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "headers/readtrace.h"
+#include "headers/registers.h"
+#include "headers/trace.h"
+
+// Largest core ID accepted, to catch corrupt traces.
+#define MAX_TRACE_CORES 65536
+
+// What is known about a core after the records read so far.
+typedef struct {
+    uint64_t registers[NUM_GENERAL_REGISTERS];
+    uint64_t next_pc;
+    uint64_t memory_address;
+    unsigned char flags;
+} CoreModel;
+
+static const char *trace_filename;
+
+static void truncated(void) {
+    fprintf(stderr, "readtrace: %s is truncated or corrupt\n", trace_filename);
+    exit(1);
+}
+
+static unsigned char read_byte(FILE *file) {
+    int byte = getc(file);
+    if (byte == EOF) {
+        truncated();
+    }
+    return byte;
+}
+
+static uint64_t read_varint(FILE *file) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned char byte = read_byte(file);
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    truncated();
+    return 0;
+}
+
+// Undoes the zigzag mapping of a signed difference.
+static uint64_t read_difference(FILE *file) {
+    uint64_t value = read_varint(file);
+    return (value >> 1) ^ (uint64_t) -(value & 1);
+}
+
+/*
+    Converts a trace written by emulate --trace into text, one line per
+    instruction: the core, PC and instruction word, then the registers
+    changed, the flags if they changed, and any memory accessed.
+*/
+int run_trace_reader(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: ./readtrace [trace_file] [optional_output_file]\n");
+        return EXIT_FAILURE;
+    }
+    trace_filename = argv[1];
+    FILE *file = fopen(trace_filename, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "readtrace: can't open %s, errno %d\n", trace_filename, errno);
+        return EXIT_FAILURE;
+    }
+    FILE *output = stdout;
+    if (argc == 3 && (output = fopen(argv[2], "w")) == NULL) {
+        fprintf(stderr, "readtrace: can't open %s, errno %d\n", argv[2], errno);
+        return EXIT_FAILURE;
+    }
+
+    char magic[sizeof(TRACE_MAGIC)];
+    unsigned char version[4];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0
+        || fread(version, 1, sizeof(version), file) != sizeof(version)
+        || (version[0] | version[1] << 8 | version[2] << 16 | (uint32_t) version[3] << 24) != TRACE_VERSION) {
+        fprintf(stderr, "readtrace: %s is not a version %d trace\n", trace_filename, TRACE_VERSION);
+        return EXIT_FAILURE;
+    }
+
+    CoreModel *models = NULL;
+    uint64_t num_models = 0;
+    uint64_t core = 0;
+    int tag;
+    while ((tag = getc(file)) != EOF) {
+        if (tag & TRACE_CORE) {
+            core = read_varint(file);
+        }
+        if (core >= num_models) {
+            if (core >= MAX_TRACE_CORES) {
+                truncated();
+            }
+            models = realloc(models, (core + 1) * sizeof(CoreModel));
+            if (models == NULL) {
+                fprintf(stderr, "readtrace: ran out of memory\n");
+                return EXIT_FAILURE;
+            }
+            memset(&models[num_models], 0, (core + 1 - num_models) * sizeof(CoreModel));
+            for (uint64_t i = num_models; i <= core; i++) {
+                models[i].flags = TRACE_RESET_FLAGS;
+            }
+            num_models = core + 1;
+        }
+        CoreModel *model = &models[core];
+
+        uint64_t pc = model->next_pc;
+        if (tag & TRACE_JUMP) {
+            pc += read_difference(file);
+        }
+        model->next_pc = pc + 4;
+        uint32_t inst = 0;
+        for (int i = 0; i < 4; i++) {
+            inst |= (uint32_t) read_byte(file) << (8 * i);
+        }
+        fprintf(output, "core %" PRIu64 " %08" PRIx64 ": %08x", core, pc, inst);
+
+        if (tag & TRACE_FLAGS) {
+            model->flags = read_byte(file);
+            fprintf(output, " PSTATE=%c%c%c%c", model->flags & TRACE_N ? 'N' : '-', model->flags & TRACE_Z ? 'Z' : '-',
+                    model->flags & TRACE_C ? 'C' : '-', model->flags & TRACE_V ? 'V' : '-');
+        }
+
+        int num_changed = read_byte(file);
+        for (int i = 0; i < num_changed; i++) {
+            int index = read_byte(file);
+            if (index >= NUM_GENERAL_REGISTERS) {
+                truncated();
+            }
+            model->registers[index] += read_difference(file);
+            fprintf(output, " X%02d=%016" PRIx64, index, model->registers[index]);
+        }
+
+        int num_accesses = read_byte(file);
+        for (int i = 0; i < num_accesses; i++) {
+            int kind = read_byte(file);
+            model->memory_address += read_difference(file);
+            fprintf(output, " %s%d [%08" PRIx64 "]", kind & TRACE_STORE ? "store" : "load",
+                    kind & TRACE_WIDE ? 64 : 32, model->memory_address);
+        }
+        fputc('\n', output);
+    }
+
+    free(models);
+    fclose(file);
+    if (output != stdout && fclose(output) != 0) {
+        fprintf(stderr, "readtrace: couldn't write %s, errno %d\n", argv[2], errno);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    return run_trace_reader(argc, argv);
+}
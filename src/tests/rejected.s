@@ -0,0 +1,3 @@
+ldr x1, [x2, #4]
+ldr w1, [x2, #2]
+str x1, [x2, #12]